@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bits.hpp"
+#include "crc/crc.hpp"
+#include "io.hpp"
+#include "reader.hpp"
+#include "select_batch.hpp"
+#include "sink.hpp"
+
+// Throughput harness for the encoders, SelectBatch, the CRCs and dump_file.
+// Every case is timed in batches sized to take a fraction of --min-time, and
+// the median batch is reported, which keeps one-off stalls (page faults,
+// frequency changes) out of the result.
+
+struct Result {
+  std::string name;
+  int samp_rate;
+  int mask_bits;
+  uint64_t iterations;
+  double ns_per_op;
+  // Samples (or bits for the CRCs) produced per call.
+  double samples_per_op;
+};
+
+static std::string key(const std::string& name, int samp_rate, int mask_bits) {
+  return name + "/" + std::to_string(samp_rate) + "/" + std::to_string(mask_bits);
+}
+
+static std::string key(const Result& r) { return key(r.name, r.samp_rate, r.mask_bits); }
+
+// Keeps the result of each call observable so that it is not optimized away.
+static volatile size_t sink_value;
+
+static void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [options]\n"
+            << "\n"
+            << "Measure the throughput of the PIE encoder, the reader commands, SelectBatch, the CRCs and dump_file.\n"
+            << "\n"
+            << "Options:\n"
+            << "  -r, --rates <list>       comma-separated sample rates (default: 1000000,2000000,4000000,20000000)\n"
+            << "  -k, --masks <list>       comma-separated Select mask lengths in bits, 0..255 (default: 0,32,96,255)\n"
+            << "  -t, --min-time <s>       time spent on each case (default: 0.2)\n"
+            << "  -f, --filter <text>      only run cases whose name contains text\n"
+            << "  -o, --json <path>        write the results as JSON ('-' for stdout, log to stderr)\n"
+            << "  -c, --compare <path>     compare against a JSON baseline and fail on regressions\n"
+            << "  -l, --tolerance <pct>    slowdown allowed by --compare (default: 10)\n"
+            << "  -h, --help               show this help\n";
+}
+
+static std::vector<int> parse_list(const std::string& text) {
+  std::vector<int> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(std::stoi(item));
+  }
+  if (values.empty()) {
+    throw std::invalid_argument("Empty list: " + text);
+  }
+  return values;
+}
+
+static BitBuffer pattern_bits(size_t n_bits) {
+  BitBuffer bits;
+  uint32_t state = 0x1234567;
+  for (size_t i = 0; i < n_bits; ++i) {
+    state = state * 1103515245 + 12345;
+    bits.push_back(state >> 16 & 1);
+  }
+  return bits;
+}
+
+// Median ns per call of fn, which returns the samples it produced.
+static Result measure(const std::string& name, int samp_rate, int mask_bits, double min_time,
+                      const std::function<size_t()>& fn) {
+  using clock = std::chrono::steady_clock;
+  const int n_batches = 5;
+
+  size_t samples = fn();
+  uint64_t batch = 1;
+  for (;;) {
+    auto start = clock::now();
+    for (uint64_t i = 0; i < batch; ++i) {
+      sink_value = fn();
+    }
+    double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    if (elapsed >= min_time / n_batches || batch >= (uint64_t(1) << 40)) {
+      break;
+    }
+    batch = elapsed > 0 ? std::max(batch * 2, uint64_t(batch * min_time / n_batches / elapsed * 1.2)) : batch * 16;
+  }
+
+  std::vector<double> times;
+  for (int b = 0; b < n_batches; ++b) {
+    auto start = clock::now();
+    for (uint64_t i = 0; i < batch; ++i) {
+      sink_value = fn();
+    }
+    times.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() / batch);
+  }
+  std::sort(times.begin(), times.end());
+  return {name, samp_rate, mask_bits, batch * n_batches, times[n_batches / 2], static_cast<double>(samples)};
+}
+
+static void print_result(std::ostream& out, const Result& r) {
+  char line[160];
+  double msps = r.samples_per_op * 1e3 / r.ns_per_op;
+  std::snprintf(line, sizeof(line), "%-14s rate=%-9d mask=%-4d %12.1f ns/op %10.1f Msamples/s", r.name.c_str(),
+                r.samp_rate, r.mask_bits, r.ns_per_op, msps);
+  out << line << std::endl;
+}
+
+static void write_json(std::ostream& out, const std::vector<Result>& results) {
+  out << "{\n  \"version\": 1,\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    char line[320];
+    std::snprintf(line, sizeof(line),
+                  "    {\"name\": \"%s\", \"samp_rate\": %d, \"mask_bits\": %d, \"iterations\": %llu, "
+                  "\"ns_per_op\": %.3f, \"samples_per_op\": %.0f, \"msamples_per_s\": %.3f}",
+                  r.name.c_str(), r.samp_rate, r.mask_bits, static_cast<unsigned long long>(r.iterations),
+                  r.ns_per_op, r.samples_per_op, r.samples_per_op * 1e3 / r.ns_per_op);
+    out << line << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n}\n";
+}
+
+// Value of "field": in one result object, as written by write_json().
+static std::string json_field(const std::string& object, const std::string& field) {
+  auto pos = object.find("\"" + field + "\"");
+  if (pos == std::string::npos) {
+    throw std::runtime_error("Baseline result without " + field + ": " + object);
+  }
+  pos = object.find(':', pos) + 1;
+  pos = object.find_first_not_of(" \t\n", pos);
+  if (object[pos] == '"') {
+    return object.substr(pos + 1, object.find('"', pos + 1) - pos - 1);
+  }
+  return object.substr(pos, object.find_first_of(",}", pos) - pos);
+}
+
+static std::map<std::string, double> read_baseline(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("Cannot open baseline " + path);
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  std::string json = text.str();
+
+  auto pos = json.find("\"results\"");
+  if (pos == std::string::npos) {
+    throw std::runtime_error("No results in baseline " + path);
+  }
+  std::map<std::string, double> baseline;
+  while ((pos = json.find('{', pos)) != std::string::npos) {
+    auto end = json.find('}', pos);
+    if (end == std::string::npos) {
+      throw std::runtime_error("Truncated baseline " + path);
+    }
+    std::string object = json.substr(pos, end - pos + 1);
+    baseline[key(json_field(object, "name"), std::stoi(json_field(object, "samp_rate")),
+                 std::stoi(json_field(object, "mask_bits")))] = std::stod(json_field(object, "ns_per_op"));
+    pos = end;
+  }
+  return baseline;
+}
+
+// Prints the change of every case present in both runs; returns the number
+// of cases slower than the baseline by more than tolerance percent.
+static int compare(std::ostream& out, const std::vector<Result>& results,
+                   const std::map<std::string, double>& baseline, double tolerance) {
+  int regressions = 0;
+  out << "\nCompared with baseline (tolerance " << tolerance << "%):\n";
+  for (const auto& r : results) {
+    auto it = baseline.find(key(r));
+    if (it == baseline.end()) {
+      continue;
+    }
+    double change = (r.ns_per_op / it->second - 1) * 100;
+    bool regressed = change > tolerance;
+    regressions += regressed;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-14s rate=%-9d mask=%-4d %12.1f -> %12.1f ns/op %+7.1f%%%s", r.name.c_str(),
+                  r.samp_rate, r.mask_bits, it->second, r.ns_per_op, change, regressed ? "  REGRESSION" : "");
+    out << line << std::endl;
+  }
+  return regressions;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<int> rates = {1000000, 2000000, 4000000, 20000000};
+  std::vector<int> masks = {0, 32, 96, 255};
+  double min_time = 0.2;
+  std::string filter;
+  std::string json_path;
+  std::string baseline_path;
+  double tolerance = 10;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) {
+          throw std::invalid_argument("Missing value for " + arg);
+        }
+        return argv[++i];
+      };
+
+      if (arg == "-h" || arg == "--help") {
+        usage(argv[0]);
+        return 0;
+      } else if (arg == "-r" || arg == "--rates") {
+        rates = parse_list(next());
+      } else if (arg == "-k" || arg == "--masks") {
+        masks = parse_list(next());
+      } else if (arg == "-t" || arg == "--min-time") {
+        min_time = std::stod(next());
+      } else if (arg == "-f" || arg == "--filter") {
+        filter = next();
+      } else if (arg == "-o" || arg == "--json") {
+        json_path = next();
+      } else if (arg == "-c" || arg == "--compare") {
+        baseline_path = next();
+      } else if (arg == "-l" || arg == "--tolerance") {
+        tolerance = std::stod(next());
+      } else {
+        throw std::invalid_argument("Unknown option: " + arg);
+      }
+    }
+    for (int mask : masks) {
+      if (mask < 0 || mask > 255) {
+        throw std::invalid_argument("Mask length out of range: " + std::to_string(mask));
+      }
+    }
+
+    // Keep stdout clean for the JSON when it goes there.
+    std::ostream& log = json_path == "-" ? std::cerr : std::cout;
+    std::vector<Result> results;
+    auto run = [&](const std::string& name, int samp_rate, int mask_bits, const std::function<size_t()>& fn) {
+      if (name.find(filter) == std::string::npos) {
+        return;
+      }
+      results.push_back(measure(name, samp_rate, mask_bits, min_time, fn));
+      print_result(log, results.back());
+    };
+
+    // The CRCs do not depend on the sample rate; they run over the mask
+    // lengths and a full PC + 96-bit EPC + CRC-16 frame.
+    std::vector<int> crc_lengths = masks;
+    crc_lengths.push_back(128);
+    for (int n_bits : crc_lengths) {
+      auto bits = pattern_bits(n_bits);
+      run("crc5", 0, n_bits, [&] {
+        sink_value = crc5(bits);
+        return bits.size();
+      });
+      run("crc16", 0, n_bits, [&] {
+        sink_value = crc16(bits);
+        return bits.size();
+      });
+    }
+
+    auto dump_path = (std::filesystem::temp_directory_path() / "epcphy_bench.cf32").string();
+    auto rn16 = pattern_bits(16);
+    for (int samp_rate : rates) {
+      auto pie = std::make_shared<const PulseIntervalEncoder>(samp_rate);
+      RFIDReaderCommand reader(pie);
+
+      run("preamble", samp_rate, 0, [&] { return pie->preamble().size(); });
+      run("frame_sync", samp_rate, 0, [&] { return pie->frame_sync().size(); });
+      run("query", samp_rate, 0, [&] { return reader.query(dr_t::DR_64_3, miller_t::M4).size(); });
+      run("query_rep", samp_rate, 0, [&] { return reader.query_rep().size(); });
+      run("query_adjust", samp_rate, 0, [&] { return reader.query_adjust().size(); });
+      run("ack", samp_rate, 0, [&] { return reader.ack(rn16).size(); });
+
+      for (int mask_bits : masks) {
+        auto mask = pattern_bits(mask_bits);
+        run("encode", samp_rate, mask_bits, [&] { return pie->encode(mask).size(); });
+        run("select", samp_rate, mask_bits,
+            [&] { return reader.select(32, static_cast<uint8_t>(mask_bits), mask).size(); });
+
+        // A run of Selects whose masks differ from the previous one only in
+        // their last byte, as in a sorted EPC list: the cost per suffix.
+        SelectBatch batch(&reader, 32);
+        auto suffix_mask = mask;
+        size_t n_suffix = std::min(mask_bits, 8);
+        uint64_t counter = 0;
+        std::vector<uint8_t> out;
+        run("select_batch", samp_rate, mask_bits, [&] {
+          suffix_mask.truncate(mask_bits - n_suffix);
+          suffix_mask.append(++counter, static_cast<int>(n_suffix));
+          out.clear();
+          VectorSink<uint8_t> sink(out);
+          batch.append(sink, suffix_mask);
+          return out.size();
+        });
+
+        auto wave = reader.select(32, static_cast<uint8_t>(mask_bits), mask);
+        run("dump_file", samp_rate, mask_bits, [&] {
+          dump_file(wave, dump_path.c_str());
+          return wave.size();
+        });
+      }
+    }
+    std::filesystem::remove(dump_path);
+
+    if (json_path == "-") {
+      write_json(std::cout, results);
+    } else if (!json_path.empty()) {
+      std::ofstream out(json_path);
+      write_json(out, results);
+      if (!out) {
+        throw std::runtime_error("Cannot write " + json_path);
+      }
+    }
+
+    if (!baseline_path.empty()) {
+      int regressions = compare(log, results, read_baseline(baseline_path), tolerance);
+      if (regressions > 0) {
+        std::cerr << regressions << " case(s) regressed by more than " << tolerance << "%" << std::endl;
+        return 1;
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
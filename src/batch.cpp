@@ -0,0 +1,162 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <mutex>
+
+#include "io.hpp"
+#include "modulator.hpp"
+#include "rle.hpp"
+#include "stats.hpp"
+
+void generate_files(ThreadPool& pool, const std::vector<FileJob>& jobs, Modulation modulation,
+                    const PulseShaper* shaper) {
+  std::mutex error_mutex;
+  size_t error_index = jobs.size();
+  std::string error_message;
+  pool.parallel_for(jobs.size(), [&](size_t i) {
+    try {
+      auto sink = FileSink{jobs[i].path, jobs[i].format, modulation};
+      if (shaper) {
+        ShapingSink shaped(*shaper, sink);
+        jobs[i].generate(shaped);
+        shaped.finish();
+      } else {
+        jobs[i].generate(sink);
+      }
+      sink.close();
+    } catch (const std::exception& e) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (i < error_index) {
+        error_index = i;
+        error_message = e.what();
+      }
+    }
+  });
+  if (error_index < jobs.size()) {
+    throw BatchError(error_index, error_message);
+  }
+}
+
+void generate_concat(ThreadPool& pool, const std::vector<WaveJob>& jobs, WaveSink& sink, size_t window) {
+  if (window == 0) {
+    window = 4 * pool.size();
+  }
+  auto render = [&jobs](size_t i) {
+    return [&jobs, i]() {
+      RleWave wave;
+      RleSink rle(wave);
+      try {
+        jobs[i](rle);
+      } catch (const std::exception& e) {
+        throw BatchError(i, e.what());
+      }
+      EPCPHY_BUFFER(wave.runs().size() * sizeof(Run));
+      return wave;
+    };
+  };
+
+  std::deque<std::future<RleWave>> in_flight;
+  size_t submitted = 0;
+  try {
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      while (submitted < jobs.size() && submitted < i + window) {
+        in_flight.push_back(pool.submit(render(submitted++)));
+      }
+      auto wave = std::move(in_flight.front());
+      in_flight.pop_front();
+      wave.get().expand_to(sink);
+    }
+  } catch (...) {
+    // The queued jobs reference jobs; let them finish before unwinding.
+    for (auto& wave : in_flight) {
+      wave.wait();
+    }
+    throw;
+  }
+}
+
+// Output slices per worker; more than one lets idle workers steal the tail
+// of a slow slice (page faults, a busy disk).
+static constexpr size_t slices_per_worker = 4;
+// Slices shorter than this cost more to schedule than to convert.
+static constexpr uint64_t min_slice_samples = 1 << 20;
+
+void generate_concat_mapped(ThreadPool& pool, const std::vector<WaveJob>& jobs, const std::string& path,
+                            iq_format_t format, Modulation modulation) {
+  if (Modulator::needed(modulation)) {
+    throw std::invalid_argument("Mapped output only supports DSB without an IF offset.");
+  }
+
+  std::vector<RleWave> waves(jobs.size());
+  std::mutex error_mutex;
+  size_t error_index = jobs.size();
+  std::string error_message;
+  pool.parallel_for(jobs.size(), [&](size_t i) {
+    try {
+      RleSink rle(waves[i]);
+      jobs[i](rle);
+    } catch (const std::exception& e) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (i < error_index) {
+        error_index = i;
+        error_message = e.what();
+      }
+    }
+  });
+  if (error_index < jobs.size()) {
+    throw BatchError(error_index, error_message);
+  }
+
+  const IQConverter converter(format, modulation);
+  uint64_t total = 0;
+  for (auto& wave : waves) {
+    total += wave.size();
+  }
+  MappedOutput out(path, total * converter.sample_size());
+
+  // First run of each slice and the samples of it that belong to the
+  // previous slice, found in one pass over the runs.
+  struct Cursor {
+    size_t wave;
+    size_t run;
+    uint64_t skip;
+  };
+  size_t n_slices = static_cast<size_t>(
+      std::clamp<uint64_t>(total / min_slice_samples, 1, slices_per_worker * (pool.size() + 1)));
+  auto slice_begin = [&](size_t k) { return total * k / n_slices; };
+  std::vector<Cursor> starts;
+  starts.reserve(n_slices);
+  uint64_t pos = 0;
+  for (size_t w = 0; w < waves.size() && starts.size() < n_slices; ++w) {
+    auto& runs = waves[w].runs();
+    for (size_t r = 0; r < runs.size() && starts.size() < n_slices; ++r) {
+      while (starts.size() < n_slices && slice_begin(starts.size()) < pos + runs[r].length) {
+        starts.push_back({w, r, slice_begin(starts.size()) - pos});
+      }
+      pos += runs[r].length;
+    }
+  }
+
+  pool.parallel_for(starts.size(), [&](size_t k) {
+    auto cursor = starts[k];
+    uint64_t remaining = slice_begin(k + 1) - slice_begin(k);
+    uint8_t* dst = out.data() + slice_begin(k) * converter.sample_size();
+    while (remaining > 0) {
+      auto& runs = waves[cursor.wave].runs();
+      if (cursor.run == runs.size()) {
+        ++cursor.wave;
+        cursor.run = 0;
+        continue;
+      }
+      auto& run = runs[cursor.run++];
+      auto n = std::min<uint64_t>(run.length - cursor.skip, remaining);
+      converter.fill(run.level, n, dst);
+      dst += n * converter.sample_size();
+      remaining -= n;
+      cursor.skip = 0;
+    }
+  });
+  out.close();
+}
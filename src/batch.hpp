@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "iq.hpp"
+#include "shaper.hpp"
+#include "sink.hpp"
+#include "thread_pool.hpp"
+
+// One waveform of a batch: appends its levels to the sink it is given. Jobs
+// run concurrently, so they must only share read-only state such as a const
+// RFIDReaderCommand.
+using WaveJob = std::function<void(WaveSink&)>;
+
+struct FileJob {
+  std::string path;
+  iq_format_t format = iq_format_t::CF32;
+  WaveJob generate;
+};
+
+// Failure of one job in a batch; index is its position in the job list.
+class BatchError : public std::runtime_error {
+ public:
+  BatchError(size_t index, const std::string& what) : std::runtime_error(what), index(index) {}
+
+  size_t index;
+};
+
+// Write every job to its own file, band-limited by shaper if given. All jobs
+// are attempted; the failure with the lowest index is rethrown as a
+// BatchError.
+void generate_files(ThreadPool& pool, const std::vector<FileJob>& jobs, Modulation modulation = {},
+                    const PulseShaper* shaper = nullptr);
+
+// Write all jobs back to back into one sink, in job order regardless of
+// which finishes first. Jobs are rendered as RleWave by the pool and
+// streamed out in order; at most window of them (0: four per worker) are
+// held at once, so memory stays bounded for arbitrarily long batches.
+void generate_concat(ThreadPool& pool, const std::vector<WaveJob>& jobs, WaveSink& sink, size_t window = 0);
+
+// Write all jobs back to back into path in two parallel passes. The pool
+// first renders every job as an RleWave, whose sample counts fix the file
+// size; the file is then preallocated and mapped, and the workers convert
+// disjoint sample ranges straight into the mapping. All rendered runs are
+// held at once (8 bytes per run, a few runs per bit). Only plain level
+// mapping can be split this way: modulations that need a Modulator, and
+// edge shaping, carry state across samples and must go through
+// generate_concat(). The failure with the lowest job index is rethrown as a
+// BatchError.
+void generate_concat_mapped(ThreadPool& pool, const std::vector<WaveJob>& jobs, const std::string& path,
+                            iq_format_t format, Modulation modulation = {});
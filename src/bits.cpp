@@ -0,0 +1,122 @@
+#include "bits.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+BitBuffer::BitBuffer(std::initializer_list<int> bits) {
+  reserve(bits.size());
+  for (int bit : bits) {
+    push_back(bit);
+  }
+}
+
+BitBuffer::BitBuffer(const std::vector<int>& bits) {
+  reserve(bits.size());
+  for (int bit : bits) {
+    push_back(bit);
+  }
+}
+
+void BitBuffer::append(uint64_t value, int n) {
+  if (n < 0 || n > 64) {
+    throw std::invalid_argument("BitBuffer::append takes at most 64 bits at a time.");
+  }
+  if (n < 64) {
+    value &= (uint64_t(1) << n) - 1;
+  }
+  while (n > 0) {
+    int used = n_bits & 7;
+    if (used == 0) {
+      if (n >= 8) {
+        // Byte-aligned fast path: emit whole bytes directly.
+        n -= 8;
+        bytes.push_back(static_cast<uint8_t>(value >> n));
+        n_bits += 8;
+        continue;
+      }
+      bytes.push_back(0);
+    }
+    int room = 8 - used;
+    int take = n < room ? n : room;
+    n -= take;
+    auto chunk = static_cast<uint8_t>((value >> n) & ((1u << take) - 1));
+    bytes.back() |= chunk << (room - take);
+    n_bits += take;
+  }
+}
+
+void BitBuffer::append(const BitBuffer& other) {
+  if ((n_bits & 7) == 0) {
+    bytes.insert(bytes.end(), other.bytes.begin(), other.bytes.end());
+    n_bits += other.n_bits;
+    return;
+  }
+  size_t n_full = other.n_bits / 8;
+  for (size_t i = 0; i < n_full; ++i) {
+    append(other.bytes[i], 8);
+  }
+  int n_rem = other.n_bits & 7;
+  if (n_rem) {
+    append(other.bytes[n_full] >> (8 - n_rem), n_rem);
+  }
+}
+
+size_t BitBuffer::count() const {
+  size_t n = 0;
+  for (uint8_t b : bytes) {
+    for (; b; b &= b - 1) {
+      ++n;
+    }
+  }
+  return n;
+}
+
+void BitBuffer::clear() {
+  bytes.clear();
+  n_bits = 0;
+}
+
+void BitBuffer::truncate(size_t n) {
+  if (n >= n_bits) {
+    return;
+  }
+  n_bits = n;
+  bytes.resize((n + 7) / 8);
+  if (n & 7) {
+    bytes.back() &= static_cast<uint8_t>(0xff << (8 - (n & 7)));
+  }
+}
+
+size_t BitBuffer::common_prefix(const BitBuffer& other) const {
+  size_t n = std::min(n_bits, other.n_bits);
+  size_t i = 0;
+  while (i < n / 8 && bytes[i] == other.bytes[i]) {
+    ++i;
+  }
+  size_t prefix = i * 8;
+  if (prefix < n) {
+    // Leading zeros of the differing byte; a plain loop, as MSVC has no
+    // __builtin_clz and this runs once per call.
+    unsigned diff = bytes[i] ^ other.bytes[i];
+    for (unsigned bit = 0x80; bit && !(diff & bit); bit >>= 1) {
+      ++prefix;
+    }
+  }
+  return std::min(prefix, n);
+}
+
+std::vector<int> BitBuffer::to_vector() const {
+  std::vector<int> bits(n_bits);
+  for (size_t i = 0; i < n_bits; ++i) {
+    bits[i] = (*this)[i];
+  }
+  return bits;
+}
+
+void ebv_append(BitBuffer& out, uint32_t value, int n_bits) {
+  int n_block = (n_bits + 6) / 7;
+  for (int n = n_block - 1; n >= 0; --n) {
+    out.push_back(n > 0);
+    out.append(value >> (n * 7), 7);
+  }
+}
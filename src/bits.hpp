@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory_resource>
+#include <vector>
+
+// Packed, MSB-first bit sequence. Bit i lives in byte i / 8 at position
+// 7 - i % 8, which is the byte layout the crc/ routines expect, so frames can
+// be checksummed in place. Unused bits of the last byte are always zero.
+// Storage comes from a std::pmr resource, the default heap unless given;
+// copies always use the default resource.
+class BitBuffer {
+ public:
+  BitBuffer() = default;
+  explicit BitBuffer(std::pmr::memory_resource* memory) : bytes(memory) {}
+  BitBuffer(std::initializer_list<int> bits);
+  explicit BitBuffer(const std::vector<int>& bits);
+
+  // Append the low n_bits bits of value, most significant first (n_bits <= 64).
+  void append(uint64_t value, int n_bits);
+  void append(const BitBuffer& other);
+  void push_back(int bit) { append(bit != 0, 1); }
+
+  int operator[](size_t i) const { return bytes[i >> 3] >> (7 - (i & 7)) & 1; }
+  size_t size() const { return n_bits; }
+  bool empty() const { return n_bits == 0; }
+  const uint8_t* data() const { return bytes.data(); }
+  size_t byte_size() const { return bytes.size(); }
+
+  // Number of set bits.
+  size_t count() const;
+
+  void reserve(size_t bits) { bytes.reserve((bits + 7) / 8); }
+  void clear();
+  // Drop all bits from position n on (no-op if n >= size()).
+  void truncate(size_t n);
+  // Length of the longest common prefix of this and other, in bits.
+  size_t common_prefix(const BitBuffer& other) const;
+  std::vector<int> to_vector() const;
+
+  bool operator==(const BitBuffer& other) const { return n_bits == other.n_bits && bytes == other.bytes; }
+  bool operator!=(const BitBuffer& other) const { return !(*this == other); }
+
+ private:
+  std::pmr::vector<uint8_t> bytes;
+  size_t n_bits = 0;
+};
+
+// Append value as an Extensible Bit Vector: the low n_bits bits are zero
+// padded to whole 7-bit blocks, each prefixed with its extension bit.
+void ebv_append(BitBuffer& out, uint32_t value, int n_bits = 32);
@@ -0,0 +1,582 @@
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "command_table.hpp"
+#include "decoder.hpp"
+#include "io.hpp"
+#include "reader.hpp"
+#include "select_batch.hpp"
+#include "sequencer.hpp"
+#include "spec.hpp"
+#include "stats.hpp"
+#include "tag.hpp"
+#include "tag_decoder.hpp"
+
+static void usage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [options] SPEC...\n"
+            << "\n"
+            << "Generate EPC Gen2 reader commands as IQ files without starting the GUI.\n"
+            << "\n"
+            << "Options:\n"
+            << "  -r, --samp-rate <Hz>  sample rate (default: 2000000)\n"
+            << "  -p, --pw <us>         PIE pulse width in microseconds (default: 12)\n"
+            << "  -x, --exact-timing    place every edge on the nearest sample instead of truncating each\n"
+            << "                        symbol to whole samples (no drift at any sample rate)\n"
+            << "  -b, --blf <Hz>        backscatter link frequency announced by Query (default: 40000)\n"
+            << "  -a, --amplitude <x>   amplitude of the carrier relative to full scale (default: 1)\n"
+            << "  -d, --depth <x>       modulation depth, 0..1 (default: 1)\n"
+            << "  -m, --modulation <m>  dsb, ssb (Hilbert) or pr (phase reversal) ASK (default: dsb)\n"
+            << "  -i, --if <Hz>         shift the output to this IF offset with an NCO (default: 0)\n"
+            << "  -s, --rise <us>       band-limit edges to this rise/fall time (default: ideal edges)\n"
+            << "  -e, --edge <shape>    edge profile with --rise: linear, cosine or gaussian (default: cosine)\n"
+            << "  -F, --format <fmt>    output format: cf32, cs16, cs8 or cu8 (default: from the file suffix)\n"
+            << "  -f, --file <path>     read additional specs from a file, one per line ('-' for stdin)\n"
+            << "  -j, --jobs <n>        worker threads (default: one per hardware thread)\n"
+            << "  -o, --concat <path>   write all specs back to back into one file, in order; out= is then\n"
+            << "                        optional and ignored\n"
+            << "  -D, --decode <path>   decode the reader commands in a cf32 capture at the sample rate and\n"
+            << "                        print one line per command instead of generating anything\n"
+            << "  -T, --decode-replies <path>[,m=<1|2|4|8>][,trext=<bool>][,reply=rn16|epc]\n"
+            << "                        decode the tag replies at the BLF in a cf32 capture and print one line\n"
+            << "                        per reply (default: m=1, trext=0, reply=rn16)\n"
+            << "  -S, --stats <path>    write per-stage timings and counters as JSON when done ('-' for stderr;\n"
+            << "                        needs a build with -DEPCPHY_STATS=ON)\n"
+            << "  -h, --help            show this help\n"
+            << "\n"
+            << "SPEC: <command>[,key=value]...,out=<path>\n"
+            << "  select       pointer, length, mask (hex), trunc, target (INV_S0..INV_S3, SL), action (0..7),\n"
+            << "               membank (FILE_TYPE, EPC, TID, FILE_0)\n"
+            << "  query        dr (8, 64/3), m (1, 2, 4, 8), trext, sel (ALL, SL, NOT_SL), session (S0..S3),\n"
+            << "               target (A, B), q (0..15)\n"
+            << "  queryrep     session\n"
+            << "  queryadjust  session, updn (0, +1, -1)\n"
+            << "  ack          rn16 (binary)\n"
+            << "  round        file (inventory round description, see below)\n"
+            << "  selects      one Select per mask in file (hex, one per line; sort it so neighbours share\n"
+            << "               prefixes), with pointer, trunc, target, action, membank and cw (us of\n"
+            << "               carrier after each)\n"
+            << "  reply        tag backscatter at the BLF: m (1, 2, 4, 8), trext, and rn16 (binary) or\n"
+            << "               epc (hex PC + EPC, CRC-16 appended)\n"
+            << "\n"
+            << "A round file lists one step per line and is emitted as one continuous waveform with\n"
+            << "Gen2 link-timing gaps (durations in microseconds):\n"
+            << "  timing,t1=<us>,t2=<us>,t4=<us>   override the nominal T1, T2 and T4\n"
+            << "  epc,length=<bits>                EPC length used for EPC reply durations\n"
+            << "  cw,duration=<us>                 unmodulated carrier\n"
+            << "  <spec without out=>[,reply=none|rn16|epc][,cw=<us>]\n"
+            << "\n"
+            << "Example:\n"
+            << "  " << prog << " query,dr=64/3,m=4,q=3,out=query.cf32 queryrep,session=S1,out=rep.cf32\n";
+}
+
+static void read_spec_file(std::istream& in, std::vector<std::string>& specs) {
+  std::string line;
+  while (std::getline(in, line)) {
+    auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    auto last = line.find_last_not_of(" \t\r");
+    specs.push_back(line.substr(first, last - first + 1));
+  }
+}
+
+// "round,file=<path>,out=<path>"
+static InventoryRound load_round(const std::string& spec, std::string& output, bool require_output) {
+  std::string file;
+  size_t start = spec.find(',') + 1;
+  while (start != 0) {
+    auto end = spec.find(',', start);
+    auto field = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    start = end + 1;
+    auto eq = field.find('=');
+    auto key = field.substr(0, eq);
+    auto value = eq == std::string::npos ? std::string() : field.substr(eq + 1);
+    if (key == "file") {
+      file = value;
+    } else if (key == "out") {
+      output = value;
+    } else {
+      throw std::invalid_argument("Unknown option '" + key + "'");
+    }
+  }
+  if (file.empty() || (require_output && output.empty())) {
+    throw std::invalid_argument("round needs file=<path> and out=<path>");
+  }
+  std::ifstream in(file);
+  if (!in) {
+    throw std::runtime_error("Cannot open round file: " + file);
+  }
+  return parse_inventory_round(in);
+}
+
+struct SelectList {
+  // Fields shared by every Select; the masks come from the file.
+  CommandSpec select;
+  std::shared_ptr<const MappedFile> masks;
+  double cw_us = 0;
+};
+
+// Call fn for every mask of a hex mask list, one per line, skipping blank
+// lines and '#' comments. The mask buffer is reused from line to line.
+template <typename F>
+static void for_each_mask(const MappedFile& file, F&& fn) {
+  auto text = reinterpret_cast<const char*>(file.data());
+  size_t size = file.size();
+  BitBuffer mask;
+  size_t line = 0;
+  for (size_t pos = 0; pos < size;) {
+    size_t end = pos;
+    while (end < size && text[end] != '\n') {
+      ++end;
+    }
+    ++line;
+    size_t first = pos;
+    while (first < end && std::isspace(static_cast<unsigned char>(text[first]))) {
+      ++first;
+    }
+    if (first < end && text[first] != '#') {
+      mask.clear();
+      for (size_t i = first; i < end; ++i) {
+        auto c = static_cast<unsigned char>(text[i]);
+        if (std::isxdigit(c)) {
+          mask.append(std::isdigit(c) ? c - '0' : std::tolower(c) - 'a' + 10, 4);
+        } else if (!std::isspace(c)) {
+          throw std::invalid_argument("Invalid hex digit on line " + std::to_string(line) + " of the mask list");
+        }
+      }
+      if (mask.size() > 255) {
+        throw std::invalid_argument("Mask on line " + std::to_string(line) + " is longer than 255 bits.");
+      }
+      fn(mask);
+    }
+    pos = end + 1;
+  }
+}
+
+// "selects,file=<masks>,pointer=<n>,...,cw=<us>,out=<path>"
+static SelectList load_selects(const std::string& spec, std::string& output, bool require_output) {
+  SelectList list;
+  std::string file;
+  std::string select = "select";
+  size_t start = spec.find(',') + 1;
+  while (start != 0) {
+    auto end = spec.find(',', start);
+    auto field = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    start = end + 1;
+    auto eq = field.find('=');
+    auto key = field.substr(0, eq);
+    auto value = eq == std::string::npos ? std::string() : field.substr(eq + 1);
+    if (key == "file") {
+      file = value;
+    } else if (key == "out") {
+      output = value;
+    } else if (key == "cw") {
+      list.cw_us = parse_double(key, value);
+      if (list.cw_us < 0) {
+        throw std::invalid_argument("CW duration must not be negative.");
+      }
+    } else if (key == "mask" || key == "length") {
+      throw std::invalid_argument("selects takes its masks from file=<path>, not '" + key + "'");
+    } else {
+      select += "," + field;
+    }
+  }
+  if (file.empty() || (require_output && output.empty())) {
+    throw std::invalid_argument("selects needs file=<path> and out=<path>");
+  }
+  list.select = parse_command_spec(select, false);
+  list.masks = std::make_shared<const MappedFile>(file);
+  // Check the whole list before anything is written.
+  for_each_mask(*list.masks, [](const BitBuffer&) {});
+  return list;
+}
+
+struct TagReply {
+  miller_t m = miller_t::M1;
+  bool trext = false;
+  BitBuffer data;
+  bool epc = false;
+};
+
+// The m= and trext= fields of reply specs and of -T; returns false for any
+// other key.
+static bool parse_link_field(const std::string& key, const std::string& value, miller_t& m, bool& trext) {
+  if (key == "m") {
+    if (value == "1") {
+      m = miller_t::M1;
+    } else if (value == "2") {
+      m = miller_t::M2;
+    } else if (value == "4") {
+      m = miller_t::M4;
+    } else if (value == "8") {
+      m = miller_t::M8;
+    } else {
+      throw std::invalid_argument("Invalid value for 'm': " + value);
+    }
+  } else if (key == "trext") {
+    trext = parse_bool(key, value);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// "reply,m=<1|2|4|8>,trext=<bool>,rn16=<bin>|epc=<hex>,out=<path>"
+static TagReply load_reply(const std::string& spec, std::string& output, bool require_output) {
+  TagReply reply;
+  bool has_data = false;
+  size_t start = spec.find(',') + 1;
+  while (start != 0) {
+    auto end = spec.find(',', start);
+    auto field = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    start = end + 1;
+    auto eq = field.find('=');
+    auto key = field.substr(0, eq);
+    auto value = eq == std::string::npos ? std::string() : field.substr(eq + 1);
+    if (key == "rn16") {
+      reply.data = bin_to_bits(value);
+      if (reply.data.size() != 16) {
+        throw std::invalid_argument("RN16 must be 16 bits long.");
+      }
+      has_data = true;
+    } else if (key == "epc") {
+      reply.data = hex_to_bits(value);
+      reply.epc = true;
+      has_data = true;
+    } else if (key == "out") {
+      output = value;
+    } else if (!parse_link_field(key, value, reply.m, reply.trext)) {
+      throw std::invalid_argument("Unknown option '" + key + "'");
+    }
+  }
+  if (!has_data || (require_output && output.empty())) {
+    throw std::invalid_argument("reply needs rn16=<bin> or epc=<hex>, and out=<path>");
+  }
+  return reply;
+}
+
+struct ReplyCapture {
+  std::string path;
+  miller_t m = miller_t::M1;
+  bool trext = false;
+  reply_t reply = reply_t::RN16;
+};
+
+// "<path>[,m=<1|2|4|8>][,trext=<bool>][,reply=rn16|epc]"
+static ReplyCapture load_reply_capture(const std::string& arg) {
+  ReplyCapture capture;
+  auto comma = arg.find(',');
+  capture.path = arg.substr(0, comma);
+  while (comma != std::string::npos) {
+    auto end = arg.find(',', comma + 1);
+    auto field = arg.substr(comma + 1, end == std::string::npos ? std::string::npos : end - comma - 1);
+    comma = end;
+    auto eq = field.find('=');
+    auto key = field.substr(0, eq);
+    auto value = eq == std::string::npos ? std::string() : field.substr(eq + 1);
+    if (key == "reply" && value == "rn16") {
+      capture.reply = reply_t::RN16;
+    } else if (key == "reply" && value == "epc") {
+      capture.reply = reply_t::EPC;
+    } else if (key == "reply") {
+      throw std::invalid_argument("Invalid value for 'reply': " + value);
+    } else if (!parse_link_field(key, value, capture.m, capture.trext)) {
+      throw std::invalid_argument("Unknown option '" + key + "'");
+    }
+  }
+  return capture;
+}
+
+int main(int argc, char* argv[]) {
+  int samp_rate = 2000000;
+  int pw_d = 12;
+  timing_t timing = timing_t::TRUNCATE;
+  double blf = 40000;
+  Modulation modulation;
+  std::string format;
+  std::string concat;
+  double rise_us = 0;
+  double if_hz = 0;
+  edge_shape_t edge = edge_shape_t::RAISED_COSINE;
+  size_t n_jobs = 0;
+  std::string decode;
+  std::string decode_replies;
+  std::string stats_path;
+  std::vector<std::string> spec_strings;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) {
+          throw std::invalid_argument("Missing value for " + arg);
+        }
+        return argv[++i];
+      };
+
+      if (arg == "-h" || arg == "--help") {
+        usage(argv[0]);
+        return 0;
+      } else if (arg == "-r" || arg == "--samp-rate") {
+        samp_rate = parse_int(arg, next());
+      } else if (arg == "-p" || arg == "--pw") {
+        pw_d = parse_int(arg, next());
+      } else if (arg == "-x" || arg == "--exact-timing") {
+        timing = timing_t::EXACT;
+      } else if (arg == "-b" || arg == "--blf") {
+        blf = parse_double(arg, next());
+      } else if (arg == "-a" || arg == "--amplitude") {
+        modulation.amplitude = static_cast<float>(parse_double(arg, next()));
+      } else if (arg == "-d" || arg == "--depth") {
+        modulation.depth = static_cast<float>(parse_double(arg, next()));
+      } else if (arg == "-m" || arg == "--modulation") {
+        auto name = next();
+        if (name == "dsb") {
+          modulation.scheme = modulation_t::DSB;
+        } else if (name == "ssb") {
+          modulation.scheme = modulation_t::SSB;
+        } else if (name == "pr") {
+          modulation.scheme = modulation_t::PR;
+        } else {
+          throw std::invalid_argument("Unknown modulation: " + name);
+        }
+      } else if (arg == "-i" || arg == "--if") {
+        if_hz = parse_double(arg, next());
+      } else if (arg == "-s" || arg == "--rise") {
+        rise_us = parse_double(arg, next());
+        if (rise_us <= 0) {
+          throw std::invalid_argument("Rise time must be positive.");
+        }
+      } else if (arg == "-e" || arg == "--edge") {
+        auto name = next();
+        if (name == "linear") {
+          edge = edge_shape_t::LINEAR;
+        } else if (name == "cosine") {
+          edge = edge_shape_t::RAISED_COSINE;
+        } else if (name == "gaussian") {
+          edge = edge_shape_t::GAUSSIAN;
+        } else {
+          throw std::invalid_argument("Unknown edge shape: " + name);
+        }
+      } else if (arg == "-F" || arg == "--format") {
+        format = next();
+        iq_format_from_name(format);
+      } else if (arg == "-f" || arg == "--file") {
+        auto path = next();
+        if (path == "-") {
+          read_spec_file(std::cin, spec_strings);
+        } else {
+          std::ifstream file(path);
+          if (!file) {
+            throw std::runtime_error("Cannot open spec file: " + path);
+          }
+          read_spec_file(file, spec_strings);
+        }
+      } else if (arg == "-j" || arg == "--jobs") {
+        int n = parse_int(arg, next());
+        if (n < 1) {
+          throw std::invalid_argument("Number of jobs must be at least 1.");
+        }
+        n_jobs = n;
+      } else if (arg == "-o" || arg == "--concat") {
+        concat = next();
+      } else if (arg == "-D" || arg == "--decode") {
+        decode = next();
+      } else if (arg == "-T" || arg == "--decode-replies") {
+        decode_replies = next();
+      } else if (arg == "-S" || arg == "--stats") {
+        stats_path = next();
+      } else if (arg.size() > 1 && arg[0] == '-') {
+        throw std::invalid_argument("Unknown option: " + arg);
+      } else {
+        spec_strings.push_back(arg);
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    usage(argv[0]);
+    return 2;
+  }
+
+  modulation.if_offset = if_hz / samp_rate;
+
+  if (!decode.empty()) {
+    try {
+      decode_file(decode, samp_rate,
+                  [&](const DecodedCommand& command) { std::cout << format_decoded(command, samp_rate) << "\n"; });
+    } catch (const std::exception& e) {
+      std::cerr << "error: " << e.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (!decode_replies.empty()) {
+    try {
+      auto capture = load_reply_capture(decode_replies);
+      auto decoder = TagDecoder{static_cast<double>(samp_rate), blf, capture.m, capture.trext, capture.reply};
+      decode_replies_file(capture.path, decoder,
+                          [](const DecodedReply& reply) { std::cout << format_reply(reply) << "\n"; });
+    } catch (const std::exception& e) {
+      std::cerr << "error: " << e.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (spec_strings.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // Validate everything before writing anything, so a typo at the end of a
+  // long batch does not leave half of the outputs behind.
+  std::vector<CommandSpec> specs;
+  std::vector<std::optional<InventoryRound>> rounds;
+  std::vector<std::optional<TagReply>> replies;
+  std::vector<std::optional<SelectList>> selects;
+  // Outputs are compared by canonical path: two sinks on one file would
+  // truncate and interleave each other.
+  std::set<std::filesystem::path> outputs;
+  std::filesystem::path concat_path;
+  if (!concat.empty()) {
+    concat_path = std::filesystem::weakly_canonical(concat);
+  }
+  specs.reserve(spec_strings.size());
+  for (auto& s : spec_strings) {
+    try {
+      CommandSpec output;
+      if (s.rfind("round,", 0) == 0) {
+        rounds.push_back(load_round(s, output.output, concat.empty()));
+        replies.emplace_back();
+        selects.emplace_back();
+        specs.push_back(std::move(output));
+      } else if (s.rfind("reply,", 0) == 0) {
+        replies.push_back(load_reply(s, output.output, concat.empty()));
+        rounds.emplace_back();
+        selects.emplace_back();
+        specs.push_back(std::move(output));
+      } else if (s.rfind("selects,", 0) == 0) {
+        selects.push_back(load_selects(s, output.output, concat.empty()));
+        rounds.emplace_back();
+        replies.emplace_back();
+        specs.push_back(std::move(output));
+      } else {
+        specs.push_back(parse_command_spec(s, concat.empty()));
+        rounds.emplace_back();
+        replies.emplace_back();
+        selects.emplace_back();
+      }
+      auto& path = specs.back().output;
+      if (!path.empty()) {
+        auto canonical = std::filesystem::weakly_canonical(path);
+        if (!concat.empty() && canonical == concat_path) {
+          throw std::invalid_argument("Output is the -o file: " + path);
+        }
+        if (concat.empty() && !outputs.insert(canonical).second) {
+          throw std::invalid_argument("Output is written by another spec: " + path);
+        }
+      }
+    } catch (const std::exception& e) {
+      std::cerr << "error: " << s << ": " << e.what() << "\n";
+      return 2;
+    }
+  }
+
+  auto output_format = [&](const std::string& path) {
+    return format.empty() ? iq_format_from_path(path) : iq_format_from_name(format);
+  };
+
+  try {
+    const auto reader = RFIDReaderCommand{std::make_shared<PulseIntervalEncoder>(samp_rate, pw_d, timing), blf};
+    // Query, QueryRep and QueryAdjust specs repeat within a batch; encode
+    // each distinct one once.
+    const auto table = CommandTable{&reader};
+    const auto sequencer = InventorySequencer{&reader};
+    std::vector<WaveJob> waves;
+    waves.reserve(specs.size());
+    for (size_t i = 0; i < specs.size(); ++i) {
+      waves.push_back([&, i](WaveSink& sink) {
+        if (replies[i]) {
+          auto& reply = *replies[i];
+          auto tag = TagEncoder{samp_rate, blf, reply.m, reply.trext, timing};
+          if (reply.epc) {
+            tag.epc_reply(sink, reply.data);
+          } else {
+            tag.reply(sink, reply.data);
+          }
+        } else if (rounds[i]) {
+          sequencer.run(sink, *rounds[i]);
+        } else if (selects[i]) {
+          auto& list = *selects[i];
+          auto& select = list.select;
+          SelectBatch batch(&reader, select.pointer, select.trunc, select.target, select.action, select.mem_bank);
+          auto n_cw = static_cast<size_t>(list.cw_us * 1e-6 * samp_rate);
+          for_each_mask(*list.masks, [&](const BitBuffer& mask) {
+            batch.append(sink, mask);
+            sink.fill(1, n_cw);
+          });
+        } else {
+          table.generate(specs[i], sink);
+        }
+      });
+    }
+
+    std::optional<PulseShaper> shaper;
+    if (rise_us > 0) {
+      shaper.emplace(samp_rate, rise_us * 1e-6, edge);
+    }
+
+    ThreadPool pool(n_jobs);
+    if (concat.empty()) {
+      std::vector<FileJob> files;
+      files.reserve(specs.size());
+      for (size_t i = 0; i < specs.size(); ++i) {
+        files.push_back({specs[i].output, output_format(specs[i].output), waves[i]});
+      }
+      generate_files(pool, files, modulation, shaper ? &*shaper : nullptr);
+    } else if (pool.size() > 1 && !shaper && !Modulator::needed(modulation) &&
+               (!std::filesystem::exists(concat) || std::filesystem::is_regular_file(concat))) {
+      // Plain level mapping into a regular file: convert in parallel into a
+      // preallocated mapping instead of streaming through one writer. With a
+      // single worker the page faults of the mapping cost more than they save.
+      generate_concat_mapped(pool, waves, concat, output_format(concat), modulation);
+    } else {
+      auto sink = FileSink{concat, output_format(concat), modulation};
+      if (shaper) {
+        ShapingSink shaped(*shaper, sink);
+        generate_concat(pool, waves, shaped);
+        shaped.finish();
+      } else {
+        generate_concat(pool, waves, sink);
+      }
+      sink.close();
+    }
+  } catch (const BatchError& e) {
+    std::cerr << "error: " << spec_strings[e.index] << ": " << e.what() << "\n";
+    return 1;
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+
+  if (stats_path == "-") {
+    std::cerr << stats_json();
+  } else if (!stats_path.empty()) {
+    std::ofstream out(stats_path);
+    out << stats_json();
+    if (!out) {
+      std::cerr << "error: cannot write " << stats_path << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include "command_table.hpp"
+
+#include <stdexcept>
+
+CommandTable::CommandTable(const RFIDReaderCommand* reader)
+    : reader(reader),
+      queries(new Entry[n_query]),
+      query_reps(new Entry[n_query_rep]),
+      query_adjusts(new Entry[n_query_adjust]) {}
+
+template <typename F>
+const RleWave& CommandTable::lookup(Entry& entry, F&& encode) const {
+  std::call_once(entry.once, [&]() {
+    RleSink sink(entry.wave);
+    encode(sink);
+  });
+  return entry.wave;
+}
+
+const RleWave& CommandTable::query(dr_t dr, miller_t m, bool trext, sel_t sel, session_t session, inventory_t target,
+                                   int q) const {
+  if (q < 0 || q > 15) {
+    throw std::invalid_argument("Q must be in 0..15.");
+  }
+  size_t index = static_cast<size_t>(dr);
+  index = index * 4 + static_cast<size_t>(m);
+  index = index * 2 + trext;
+  index = index * 3 + static_cast<size_t>(sel);
+  index = index * 4 + static_cast<size_t>(session);
+  index = index * 2 + static_cast<size_t>(target);
+  index = index * 16 + q;
+  return lookup(queries[index],
+                [&](WaveSink& sink) { reader->query(sink, dr, m, trext, sel, session, target, q); });
+}
+
+const RleWave& CommandTable::query_rep(session_t session) const {
+  return lookup(query_reps[static_cast<size_t>(session)], [&](WaveSink& sink) { reader->query_rep(sink, session); });
+}
+
+const RleWave& CommandTable::query_adjust(session_t session, updn_t updn) const {
+  size_t index = static_cast<size_t>(session) * 3 + static_cast<size_t>(updn);
+  return lookup(query_adjusts[index], [&](WaveSink& sink) { reader->query_adjust(sink, session, updn); });
+}
+
+void CommandTable::generate(const CommandSpec& spec, WaveSink& sink) const {
+  switch (spec.command) {
+    case command_t::QUERY:
+      query(spec.dr, spec.miller, spec.trext, spec.sel, spec.session, spec.inventory, spec.q).expand_to(sink);
+      break;
+    case command_t::QUERY_REP:
+      query_rep(spec.session).expand_to(sink);
+      break;
+    case command_t::QUERY_ADJUST:
+      query_adjust(spec.session, spec.updn).expand_to(sink);
+      break;
+    default:
+      generate_command(*reader, spec, sink);
+      break;
+  }
+}
+
+void CommandTable::build_all() const {
+  for (auto dr : {dr_t::DR_8, dr_t::DR_64_3}) {
+    for (auto m : {miller_t::M1, miller_t::M2, miller_t::M4, miller_t::M8}) {
+      for (bool trext : {false, true}) {
+        for (auto sel : {sel_t::ALL, sel_t::SL, sel_t::NOT_SL}) {
+          for (auto session : {session_t::S0, session_t::S1, session_t::S2, session_t::S3}) {
+            for (auto target : {inventory_t::A, inventory_t::B}) {
+              for (int q = 0; q < 16; ++q) {
+                query(dr, m, trext, sel, session, target, q);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  for (auto session : {session_t::S0, session_t::S1, session_t::S2, session_t::S3}) {
+    query_rep(session);
+    for (auto updn : {updn_t::UNCHANGED, updn_t::INCREACE, updn_t::DECREASE}) {
+      query_adjust(session, updn);
+    }
+  }
+}
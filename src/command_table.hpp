@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#include "reader.hpp"
+#include "rle.hpp"
+#include "sink.hpp"
+#include "spec.hpp"
+
+// Waveforms of every QueryRep (4), QueryAdjust (12) and Query (3072) for
+// one reader configuration. Entries are encoded on first use and kept, so
+// a repeated command costs a lookup plus a copy of its runs. Lookups are
+// safe from any number of threads.
+class CommandTable {
+ public:
+  explicit CommandTable(const RFIDReaderCommand* reader);
+
+  const RleWave& query(dr_t dr = dr_t::DR_8, miller_t m = miller_t::M1, bool trext = false, sel_t sel = sel_t::ALL,
+                       session_t session = session_t::S0, inventory_t target = inventory_t::A, int q = 0) const;
+  const RleWave& query_rep(session_t session = session_t::S0) const;
+  const RleWave& query_adjust(session_t session = session_t::S0, updn_t updn = updn_t::UNCHANGED) const;
+
+  // Like generate_command(), but served from the table where possible;
+  // Select and Ack are passed through to the reader.
+  void generate(const CommandSpec& spec, WaveSink& sink) const;
+
+  // Encode every entry now instead of on first use.
+  void build_all() const;
+
+  static constexpr size_t n_query = 2 * 4 * 2 * 3 * 4 * 2 * 16;
+  static constexpr size_t n_query_rep = 4;
+  static constexpr size_t n_query_adjust = 4 * 3;
+
+ private:
+  struct Entry {
+    std::once_flag once;
+    RleWave wave;
+  };
+
+  template <typename F>
+  const RleWave& lookup(Entry& entry, F&& encode) const;
+
+  const RFIDReaderCommand* reader;
+  std::unique_ptr<Entry[]> queries;
+  std::unique_ptr<Entry[]> query_reps;
+  std::unique_ptr<Entry[]> query_adjusts;
+};
@@ -1,52 +1,93 @@
-#include <vector>
+#include "crc.hpp"
+
+#include "../stats.hpp"
 
 extern "C" {
 #include "crc16genibus.h"
 #include "crc5epc_c1g2.h"
 }
 
-std::vector<int> crc5(std::vector<int> bits) {
-  int n_byte = bits.size() / 8;
-  int n_rem = bits.size() % 8;
-  unsigned char data[n_byte];
-  for (int i = 0; i < n_byte; i++) {
-    data[i] = 0;
-    for (int j = 0; j < 8; j++) {
-      data[i] |= bits[i * 8 + j] << (7 - j);
-    }
-  }
-  uint8_t crc = n_byte == 0 ? 0x09 : crc5epc_c1g2_byte(0x9, data, n_byte);
-  unsigned rem = 0;
-  for (int i = 0; i < n_rem; i++) {
-    rem |= bits[n_byte * 8 + i] << (7 - i);
+// The _word routines are slice-by-8 but read 64-bit words little-endian.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define EPCPHY_CRC_WORD 1
+#endif
+
+struct Crc5 {
+  using value_type = uint8_t;
+  static uint8_t bytes(uint8_t crc, const uint8_t* data, size_t n) {
+#ifdef EPCPHY_CRC_WORD
+    return crc5epc_c1g2_word(crc, data, n);
+#else
+    return crc5epc_c1g2_byte(crc, data, n);
+#endif
   }
-  crc = crc5epc_c1g2_rem(crc, rem, n_rem);
-  std::vector<int> crc_bits(5);
-  for (int i = 0; i < 5; i++) {
-    crc_bits[4 - i] = crc >> i & 1;
+  static uint8_t rem(uint8_t crc, unsigned val, unsigned bits) { return crc5epc_c1g2_rem(crc, val, bits); }
+};
+
+struct Crc16 {
+  using value_type = uint16_t;
+  static uint16_t bytes(uint16_t crc, const uint8_t* data, size_t n) {
+#ifdef EPCPHY_CRC_WORD
+    return crc16genibus_word(crc, data, n);
+#else
+    return crc16genibus_byte(crc, data, n);
+#endif
   }
-  return crc_bits;
-}
+  static uint16_t rem(uint16_t crc, unsigned val, unsigned bits) { return crc16genibus_rem(crc, val, bits); }
+};
+
+// Bytes realigned per chunk when the message does not start on a byte
+// boundary; small enough for the stack, large enough for the word loop.
+static constexpr size_t realign_chunk = 256;
 
-std::vector<int> crc16(std::vector<int> bits) {
-  int n_byte = bits.size() / 8;
-  int n_rem = bits.size() % 8;
-  unsigned char data[n_byte];
-  for (int i = 0; i < n_byte; i++) {
-    data[i] = 0;
-    for (int j = 0; j < 8; j++) {
-      data[i] |= bits[i * 8 + j] << (7 - j);
+template <typename C>
+static typename C::value_type crc_bits(const uint8_t* data, size_t bit_offset, size_t n_bits, typename C::value_type crc) {
+  data += bit_offset / 8;
+  unsigned shift = bit_offset % 8;
+  size_t n_bytes = n_bits / 8;
+  unsigned n_rem = n_bits % 8;
+
+  if (shift == 0) {
+    if (n_bytes) {
+      crc = C::bytes(crc, data, n_bytes);
     }
+    return n_rem ? C::rem(crc, data[n_bytes], n_rem) : crc;
   }
-  uint16_t crc = n_byte == 0 ? 0x0000 : crc16genibus_byte(0x0000, data, n_byte);
-  unsigned rem = 0;
-  for (int i = 0; i < n_rem; i++) {
-    rem |= bits[n_byte * 8 + i] << (7 - i);
+
+  // Every realigned byte takes its low bits from the next input byte, which
+  // lies within the message since the message extends shift bits past it.
+  uint8_t aligned[realign_chunk];
+  while (n_bytes) {
+    size_t n = n_bytes < realign_chunk ? n_bytes : realign_chunk;
+    for (size_t i = 0; i < n; ++i) {
+      aligned[i] = static_cast<uint8_t>(data[i] << shift | data[i + 1] >> (8 - shift));
+    }
+    crc = C::bytes(crc, aligned, n);
+    data += n;
+    n_bytes -= n;
   }
-  crc = crc16genibus_rem(crc, rem, n_rem);
-  std::vector<int> crc_bits(16);
-  for (int i = 0; i < 16; i++) {
-    crc_bits[15 - i] = crc >> i & 1;
+  if (n_rem) {
+    unsigned val = data[0] << shift;
+    if (shift + n_rem > 8) {
+      val |= data[1] >> (8 - shift);
+    }
+    crc = C::rem(crc, val & 0xff, n_rem);
   }
-  return crc_bits;
+  return crc;
+}
+
+uint8_t crc5(const uint8_t* data, size_t bit_offset, size_t n_bits, uint8_t crc) {
+  EPCPHY_STAGE(stage_t::CRC);
+  EPCPHY_COUNT(stage_t::CRC, 0, (n_bits + 7) / 8);
+  return crc_bits<Crc5>(data, bit_offset, n_bits, crc);
 }
+
+uint16_t crc16(const uint8_t* data, size_t bit_offset, size_t n_bits, uint16_t crc) {
+  EPCPHY_STAGE(stage_t::CRC);
+  EPCPHY_COUNT(stage_t::CRC, 0, (n_bits + 7) / 8);
+  return crc_bits<Crc16>(data, bit_offset, n_bits, crc);
+}
+
+uint8_t crc5(const BitBuffer& bits) { return crc5(bits.data(), 0, bits.size()); }
+
+uint16_t crc16(const BitBuffer& bits) { return crc16(bits.data(), 0, bits.size()); }
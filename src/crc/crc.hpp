@@ -1,6 +1,20 @@
 #pragma once
 
-#include <vector>
+#include <cstddef>
+#include <cstdint>
 
-std::vector<int> crc5(std::vector<int> bits);
-std::vector<int> crc16(std::vector<int> bits);
+#include "../bits.hpp"
+
+// Initial register values, i.e. the CRC of zero bits.
+constexpr uint8_t crc5_init = 0x09;
+constexpr uint16_t crc16_init = 0x0000;
+
+uint8_t crc5(const BitBuffer& bits);
+uint16_t crc16(const BitBuffer& bits);
+
+// CRC of n_bits bits of MSB-first packed data starting bit_offset bits into
+// data, continuing from crc. Feeding a message in pieces gives the same
+// result as feeding it at once, so callers can checksum a frame in place or
+// resume from a stored register value.
+uint8_t crc5(const uint8_t* data, size_t bit_offset, size_t n_bits, uint8_t crc = crc5_init);
+uint16_t crc16(const uint8_t* data, size_t bit_offset, size_t n_bits, uint16_t crc = crc16_init);
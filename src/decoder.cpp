@@ -0,0 +1,381 @@
+#include "decoder.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+
+#include "crc/crc.hpp"
+#include "io.hpp"
+
+// Samples per carrier level update; the level decays by carrier_decay per
+// block.
+static constexpr size_t block_size = 4096;
+static constexpr float carrier_decay = 0.999f;
+// Samples above this fraction of the block peak power count as carrier.
+static constexpr float carrier_floor = 0.25f;
+// Slicer hysteresis as fractions of the carrier amplitude, squared for power.
+static constexpr float on_power = 0.6f * 0.6f;
+static constexpr float off_power = 0.4f * 0.4f;
+// Longest frame accepted, in symbols; a Select is at most ~330 bits.
+static constexpr size_t max_symbols = 1024;
+
+PieDecoder::PieDecoder(double samp_rate, Handler handler) : handler(std::move(handler)) {
+  if (samp_rate <= 0) {
+    throw std::invalid_argument("Sample rate must be positive.");
+  }
+  // Delimiter 12.5 us +-5% nominal, widened for readers that use 12 us, for
+  // edges blurred by filtering and for SSB, whose quadrature component fills
+  // in the edges of every low pulse and leaves about 8 us below threshold. Tari is at most 25 us. TRcal should be
+  // at most 3 RTcal, but DR = 64/3 at the lowest BLF (40 kHz) gives 533 us.
+  delim_min = static_cast<uint32_t>(5e-6 * samp_rate);
+  delim_max = static_cast<uint32_t>(16e-6 * samp_rate) + 1;
+  tari_max = static_cast<uint32_t>(27.5e-6 * samp_rate) + 1;
+  trcal_max = static_cast<uint32_t>(600e-6 * samp_rate) + 1;
+  smooth = std::clamp<size_t>(static_cast<size_t>(1e-6 * samp_rate), 1, block_size);
+  history.assign(smooth + block_size, 0.0f);
+  // Samples from an ideal edge until the smoothed power crosses the
+  // threshold, to report offsets at the edges of the capture itself.
+  fall_delay = static_cast<uint32_t>(smooth * (1 - off_power));
+  rise_delay = static_cast<uint32_t>(smooth * on_power);
+  symbols.reserve(max_symbols);
+}
+
+void PieDecoder::process(const std::complex<float>* samples, size_t n) {
+  // power holds the last `smooth` powers of the previous block, then this one.
+  float* power = history.data() + smooth;
+  float envelope[block_size];
+  for (size_t i = 0; i < n; i += block_size) {
+    size_t m = std::min(block_size, n - i);
+    for (size_t j = 0; j < m; ++j) {
+      float re = samples[i + j].real();
+      float im = samples[i + j].imag();
+      power[j] = re * re + im * im;
+    }
+    // Boxcar over `smooth` samples; delays both edges alike, so symbol
+    // lengths are kept. The sum restarts every block to bound drift.
+    float sum = 0;
+    for (size_t j = 0; j < smooth; ++j) {
+      sum += history[j];
+    }
+    float scale = 1.0f / smooth;
+    float peak = 0;
+    for (size_t j = 0; j < m; ++j) {
+      sum += power[j] - power[j - smooth];
+      envelope[j] = sum * scale;
+      peak = std::max(peak, envelope[j]);
+    }
+    std::copy(power + m - smooth, power + m, history.data());
+
+    // The peak itself overestimates the carrier under SSB, whose edges
+    // overshoot to about 1.76 times the CW amplitude; the mean of the
+    // samples near the top is dominated by the flat carrier instead.
+    float carrier_sum = 0;
+    size_t n_carrier = 0;
+    for (size_t j = 0; j < m; ++j) {
+      if (envelope[j] >= carrier_floor * peak) {
+        carrier_sum += envelope[j];
+        ++n_carrier;
+      }
+    }
+    float carrier = n_carrier ? carrier_sum / n_carrier : 0;
+    carrier_power = std::max(carrier, carrier_power * carrier_decay);
+    float on = on_power * carrier_power;
+    float off = off_power * carrier_power;
+
+    size_t j = 0;
+    while (j < m) {
+      if (level) {
+        while (j < m && envelope[j] >= off) {
+          ++j;
+        }
+      } else {
+        while (j < m && envelope[j] <= on) {
+          ++j;
+        }
+      }
+      if (j < m) {
+        uint64_t edge = pos + j;
+        on_run(level, run_start, edge - run_start);
+        level = !level;
+        run_start = edge;
+      }
+    }
+    pos += m;
+  }
+}
+
+void PieDecoder::finish() {
+  if (pos > run_start) {
+    on_run(level, run_start, pos - run_start);
+    run_start = pos;
+  }
+  if (in_frame) {
+    end_frame();
+  }
+}
+
+void PieDecoder::on_run(uint8_t run_level, uint64_t start, uint64_t length) {
+  if (run_level) {
+    if (in_frame) {
+      // Longest high part of the next symbol: data-0, RTcal, TRcal or a data
+      // symbol. Anything longer is carrier.
+      size_t n = symbols.size();
+      uint64_t limit;
+      if (n == 0) {
+        limit = tari_max;
+      } else if (n == 1) {
+        limit = 3 * tari_max;
+      } else if (n == 2) {
+        limit = std::max<uint64_t>(trcal_max, symbols[1] * 33 / 10);
+      } else {
+        limit = symbols[1];
+      }
+      if (length > limit) {
+        end_frame();
+      } else {
+        high = length;
+      }
+    }
+    last_high = length;
+    return;
+  }
+
+  if (in_frame) {
+    if (length > delim_max) {
+      // Carrier dropped: the last symbol is lost in the gap.
+      end_frame();
+      return;
+    }
+    symbols.push_back(static_cast<uint32_t>(high + length));
+    frame_end = start + length - rise_delay;
+    if (symbols.size() > max_symbols) {
+      in_frame = false;
+    }
+  } else if (length >= delim_min && length <= delim_max && last_high >= delim_min) {
+    in_frame = true;
+    frame_start = start - std::min<uint64_t>(start, fall_delay);
+    frame_end = start + length;
+    symbols.clear();
+  }
+}
+
+static uint32_t field(const BitBuffer& bits, size_t pos, int n) {
+  uint32_t value = 0;
+  for (int i = 0; i < n; ++i) {
+    value = value << 1 | bits[pos + i];
+  }
+  return value;
+}
+
+static session_t session_field(uint32_t v) {
+  static const session_t sessions[] = {session_t::S0, session_t::S1, session_t::S2, session_t::S3};
+  return sessions[v];
+}
+
+static miller_t miller_field(uint32_t v) {
+  static const miller_t millers[] = {miller_t::M1, miller_t::M2, miller_t::M4, miller_t::M8};
+  return millers[v];
+}
+
+static bool parse_query(const BitBuffer& bits, CommandSpec& spec, crc_status_t& crc) {
+  if (bits.size() != 22) {
+    return false;
+  }
+  spec.command = command_t::QUERY;
+  spec.dr = bits[4] ? dr_t::DR_64_3 : dr_t::DR_8;
+  spec.miller = miller_field(field(bits, 5, 2));
+  spec.trext = bits[7];
+  switch (field(bits, 8, 2)) {
+    case 0b10:
+      spec.sel = sel_t::NOT_SL;
+      break;
+    case 0b11:
+      spec.sel = sel_t::SL;
+      break;
+    default:
+      spec.sel = sel_t::ALL;
+      break;
+  }
+  spec.session = session_field(field(bits, 10, 2));
+  spec.inventory = bits[12] ? inventory_t::B : inventory_t::A;
+  spec.q = field(bits, 13, 4);
+  crc = crc5(bits.data(), 0, 17) == field(bits, 17, 5) ? crc_status_t::OK : crc_status_t::BAD;
+  return true;
+}
+
+static bool parse_query_adjust(const BitBuffer& bits, CommandSpec& spec) {
+  if (bits.size() != 9) {
+    return false;
+  }
+  spec.command = command_t::QUERY_ADJUST;
+  spec.session = session_field(field(bits, 4, 2));
+  switch (field(bits, 6, 3)) {
+    case 0b000:
+      spec.updn = updn_t::UNCHANGED;
+      break;
+    case 0b110:
+      spec.updn = updn_t::INCREACE;
+      break;
+    case 0b011:
+      spec.updn = updn_t::DECREASE;
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+static bool parse_select(const BitBuffer& bits, CommandSpec& spec) {
+  // Opcode, target, action, membank, one EBV block, length, trunc, CRC-16.
+  if (bits.size() < 4 + 3 + 3 + 2 + 8 + 8 + 1 + 16) {
+    return false;
+  }
+  static const target_t targets[] = {target_t::INV_S0, target_t::INV_S1, target_t::INV_S2, target_t::INV_S3,
+                                     target_t::SL};
+  static const membank_t banks[] = {membank_t::FILE_TYPE, membank_t::EPC, membank_t::TID, membank_t::FILE_0};
+  uint32_t target = field(bits, 4, 3);
+  if (target > 4) {
+    return false;
+  }
+  spec.command = command_t::SELECT;
+  spec.target = targets[target];
+  spec.action = field(bits, 7, 3);
+  spec.mem_bank = banks[field(bits, 10, 2)];
+
+  size_t pos = 12;
+  uint64_t pointer = 0;
+  bool more = true;
+  while (more) {
+    if (pos + 8 > bits.size() || pos >= 12 + 5 * 8) {
+      return false;
+    }
+    more = bits[pos];
+    pointer = pointer << 7 | field(bits, pos + 1, 7);
+    pos += 8;
+  }
+  if (pointer > static_cast<uint64_t>(INT32_MAX) || pos + 8 > bits.size()) {
+    return false;
+  }
+  spec.pointer = static_cast<int>(pointer);
+  spec.length = field(bits, pos, 8);
+  pos += 8;
+  if (pos + spec.length + 1 + 16 != bits.size()) {
+    return false;
+  }
+  spec.mask.clear();
+  for (int i = 0; i < spec.length; ++i) {
+    spec.mask.push_back(bits[pos + i]);
+  }
+  spec.trunc = bits[pos + spec.length];
+  return true;
+}
+
+static std::optional<CommandSpec> parse_frame(const BitBuffer& bits, bool preamble, crc_status_t& crc) {
+  crc = crc_status_t::NONE;
+  CommandSpec spec;
+  bool known = false;
+  if (preamble) {
+    known = bits.size() >= 4 && field(bits, 0, 4) == 0b1000 && parse_query(bits, spec, crc);
+  } else if (bits.size() >= 2 && !bits[0]) {
+    if (!bits[1] && bits.size() == 4) {
+      spec.command = command_t::QUERY_REP;
+      spec.session = session_field(field(bits, 2, 2));
+      known = true;
+    } else if (bits[1] && bits.size() == 18) {
+      spec.command = command_t::ACK;
+      for (size_t i = 2; i < 18; ++i) {
+        spec.rn16.push_back(bits[i]);
+      }
+      known = true;
+    }
+  } else if (bits.size() >= 4 && field(bits, 0, 4) == 0b1001) {
+    known = parse_query_adjust(bits, spec);
+  } else if (bits.size() >= 4 && field(bits, 0, 4) == 0b1010) {
+    known = parse_select(bits, spec);
+  }
+
+  // Select and the 8-bit opcodes (Req_RN, Read, Write, ...) end in a CRC-16.
+  bool has_crc16 = (known && spec.command == command_t::SELECT) ||
+                   (!known && bits.size() > 8 + 16 && bits[0] && bits[1]);
+  if (has_crc16) {
+    size_t n = bits.size() - 16;
+    crc = crc16(bits.data(), 0, n) == field(bits, n, 16) ? crc_status_t::OK : crc_status_t::BAD;
+  }
+  if (!known) {
+    return std::nullopt;
+  }
+  return spec;
+}
+
+void PieDecoder::end_frame() {
+  in_frame = false;
+  size_t n = symbols.size();
+  if (n < 3) {
+    return;
+  }
+  uint32_t tari = symbols[0];
+  uint32_t rtcal = symbols[1];
+  // RTcal is 2.5 to 3 Tari; allow a sample of rounding and 6% of edge
+  // distortion (SSB moves edges by different amounts) either way.
+  if (tari > tari_max || 1.06 * rtcal + 1 < 2.5 * tari || rtcal > 3.0 * 1.06 * tari + 1) {
+    return;
+  }
+
+  size_t i = 2;
+  uint32_t trcal = 0;
+  if (symbols[2] > rtcal) {
+    trcal = symbols[2];
+    i = 3;
+  }
+  uint32_t pivot = rtcal / 2;
+  BitBuffer bits;
+  bits.reserve(n - i);
+  for (; i < n; ++i) {
+    if (symbols[i] > rtcal) {
+      return;
+    }
+    bits.push_back(symbols[i] > pivot);
+  }
+  if (bits.empty()) {
+    return;
+  }
+
+  DecodedCommand command;
+  command.offset = frame_start;
+  command.length = frame_end - frame_start;
+  command.tari = tari;
+  command.rtcal = rtcal;
+  command.trcal = trcal;
+  command.spec = parse_frame(bits, trcal != 0, command.crc);
+  command.bits = std::move(bits);
+  handler(command);
+}
+
+void decode_file(const std::string& path, double samp_rate, const PieDecoder::Handler& handler) {
+  MappedFile file(path);
+  if (file.size() % sizeof(std::complex<float>) != 0) {
+    throw std::runtime_error("Input is not a whole number of cf32 samples: " + path);
+  }
+  PieDecoder decoder(samp_rate, handler);
+  decoder.process(reinterpret_cast<const std::complex<float>*>(file.data()),
+                  file.size() / sizeof(std::complex<float>));
+  decoder.finish();
+}
+
+std::string format_decoded(const DecodedCommand& command, double samp_rate) {
+  static const char* crc_names[] = {"none", "ok", "bad"};
+  double us = 1e6 / samp_rate;
+  char timing[160];
+  std::snprintf(timing, sizeof(timing), "offset=%llu length=%llu tari=%.2f rtcal=%.2f trcal=%.2f crc=%s ",
+                static_cast<unsigned long long>(command.offset), static_cast<unsigned long long>(command.length),
+                command.tari * us, command.rtcal * us, command.trcal * us,
+                crc_names[static_cast<int>(command.crc)]);
+  std::string line = timing;
+  if (command.spec) {
+    line += format_command_spec(*command.spec);
+  } else {
+    line += "unknown,bits=" + bits_to_bin(command.bits);
+  }
+  return line;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "bits.hpp"
+#include "spec.hpp"
+
+enum class crc_status_t { NONE, OK, BAD };
+
+// A reader command recovered from a capture.
+struct DecodedCommand {
+  // Sample index of the delimiter, and samples up to the end of the last
+  // data symbol.
+  uint64_t offset;
+  uint64_t length;
+  // Frame-sync symbol lengths in samples; trcal is 0 without a preamble.
+  uint32_t tari;
+  uint32_t rtcal;
+  uint32_t trcal;
+  BitBuffer bits;
+  // Command fields, unless the frame is not one of the commands epcphy
+  // generates or has the wrong length for its opcode.
+  std::optional<CommandSpec> spec;
+  // CRC-5 for Query, CRC-16 for Select and the other 8-bit opcodes.
+  crc_status_t crc;
+};
+
+// Streaming decoder for reader-to-tag PIE in complex baseband captures. The
+// power is smoothed over a microsecond and sliced with hysteresis relative
+// to a decaying estimate of the carrier level (the mean power of the samples
+// near the top of each block, which SSB edge overshoot barely moves), so the
+// input may be DSB, SSB or PR ASK at any amplitude or IF offset. Runs of the
+// sliced envelope are matched against the frame-sync: a delimiter after
+// carrier, data-0 (Tari), RTcal and, for a preamble, TRcal. Data symbols are
+// then sliced at RTcal / 2 until the carrier stays up for longer than a
+// symbol. Runs are never buffered, so memory use does not depend on the
+// length of the capture.
+class PieDecoder {
+ public:
+  using Handler = std::function<void(const DecodedCommand&)>;
+
+  PieDecoder(double samp_rate, Handler handler);
+
+  void process(const std::complex<float>* samples, size_t n);
+  // Flush a frame still open at the end of the capture.
+  void finish();
+
+  uint64_t samples_processed() const { return pos; }
+
+ private:
+  void on_run(uint8_t run_level, uint64_t start, uint64_t length);
+  void end_frame();
+
+  Handler handler;
+  uint32_t delim_min;
+  uint32_t delim_max;
+  uint32_t tari_max;
+  uint32_t trcal_max;
+
+  // Envelope smoothing length and the power history it needs.
+  size_t smooth;
+  std::vector<float> history;
+  uint32_t fall_delay;
+  uint32_t rise_delay;
+  float carrier_power = 0;
+  uint8_t level = 0;
+  uint64_t run_start = 0;
+  uint64_t pos = 0;
+
+  bool in_frame = false;
+  uint64_t frame_start = 0;
+  uint64_t frame_end = 0;
+  uint64_t last_high = 0;
+  uint64_t high = 0;
+  // High plus low run of every symbol after the delimiter.
+  std::vector<uint32_t> symbols;
+};
+
+// Decode a whole cf32 capture through a read-only memory map.
+void decode_file(const std::string& path, double samp_rate, const PieDecoder::Handler& handler);
+
+// One log line: sample offset and length, frame-sync timing, CRC status and
+// the command in epcphy-cli spec syntax.
+std::string format_decoded(const DecodedCommand& command, double samp_rate);
@@ -1,17 +1,42 @@
 #include "gui.hpp"
 
-#include <complex>
-#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
 
+#include "io.hpp"
+#include "iq.hpp"
 #include "reader.hpp"
-
-void dump_file(const std::vector<int>& data, const char* path) {
-  std::ofstream file(path, std::ios::binary);
-  for (int i = 0; i < data.size(); i++) {
-    auto sample = std::complex<float>(data[i], 0);
-    file.write(reinterpret_cast<const char*>(&sample), sizeof(sample));
+#include "rle.hpp"
+
+// Longest fill handed to the sink between cancellation checks.
+static constexpr size_t fill_chunk = 1 << 20;
+
+// Render job as runs, which is cheap and gives the exact output size, then
+// expand it into the file. progress gets the bytes written so far and the
+// total; returns false when cancelled.
+static bool write_job(const WaveJob& job, const std::string& path, const std::atomic<bool>& cancel,
+                      const std::function<void(uint64_t, uint64_t)>& progress) {
+  RleWave wave;
+  RleSink rle(wave);
+  job(rle);
+
+  FileSink sink(path);
+  uint64_t total = wave.size() * iq_sample_size(iq_format_from_path(path));
+  for (auto& run : wave.runs()) {
+    for (size_t done = 0; done < run.length;) {
+      if (cancel) {
+        return false;
+      }
+      size_t n = std::min<size_t>(run.length - done, fill_chunk);
+      sink.fill(run.level, n);
+      done += n;
+      progress(sink.bytes_written(), total);
+    }
   }
-  file.close();
+  sink.close();
+  progress(total, total);
+  return true;
 }
 
 MainWindow::MainWindow() : QMainWindow() {
@@ -29,39 +54,152 @@ MainWindow::MainWindow() : QMainWindow() {
   command_option_widgets = {new SelectOptionsWidget(), new QueryOptionsWidget(), new QueryRepOptionsWidget(),
                             new QueryAdjustOptionsWidget(), new AckOptionsWidget()};
   generate_btn = new QPushButton("Generate", central_widget);
+  cancel_btn = new QPushButton("Cancel", central_widget);
+  progress_bar = new QProgressBar(central_widget);
+  progress_bar->setRange(0, 1000);
+  progress_bar->setTextVisible(false);
+  progress_bar->hide();
+  cancel_btn->hide();
+  preview = new WavePreview(2000000, central_widget);
   vbox->addWidget(command_input);
   vbox->addLayout(options_widget_wrapper);
-  vbox->addStretch();
+  vbox->addWidget(preview, 1);
 
-  vbox->addWidget(generate_btn);
+  vbox->addWidget(progress_bar);
+  auto buttons = new QHBoxLayout();
+  buttons->addWidget(generate_btn);
+  buttons->addWidget(cancel_btn);
+  vbox->addLayout(buttons);
   connect(generate_btn, &QPushButton::clicked, this, &MainWindow::generate);
+  connect(cancel_btn, &QPushButton::clicked, this, &MainWindow::cancel);
   connect(command_input, &QComboBox::currentIndexChanged, this, &MainWindow::handle_command_change);
+  for (auto widget : command_option_widgets) {
+    for (auto edit : widget->findChildren<QLineEdit*>()) {
+      connect(edit, &QLineEdit::textChanged, this, &MainWindow::update_preview);
+    }
+    for (auto box : widget->findChildren<QComboBox*>()) {
+      connect(box, &QComboBox::currentIndexChanged, this, &MainWindow::update_preview);
+    }
+    for (auto check : widget->findChildren<QCheckBox*>()) {
+      connect(check, &QCheckBox::toggled, this, &MainWindow::update_preview);
+    }
+  }
   handle_command_change(0);
   central_widget->setMinimumWidth(400);
 }
 
 void MainWindow::generate() {
+  if (worker) {
+    return;
+  }
   qDebug() << "Generating command...";
+  // Check the settings before asking for a file.
+  WaveJob job;
+  try {
+    job = command_option_widgets[command_input->currentIndex()]->make_job();
+  } catch (const std::exception& e) {
+    QMessageBox::critical(this, "Error", QString("Invalid settings: ") + e.what());
+    return;
+  }
+
   QFileDialog dialog(this);
   dialog.setFileMode(QFileDialog::AnyFile);
   dialog.setAcceptMode(QFileDialog::AcceptSave);
   dialog.setDefaultSuffix("cf32");
+  dialog.setNameFilters({"cf32 (*.cf32)", "cs16 (*.cs16)", "cs8 (*.cs8)", "cu8 (*.cu8)"});
+  connect(&dialog, &QFileDialog::filterSelected, &dialog,
+          [&dialog](const QString& filter) { dialog.setDefaultSuffix(filter.section(' ', 0, 0)); });
   dialog.setViewMode(QFileDialog::Detail);
   dialog.setDirectory(QDir::homePath());
   dialog.setWindowTitle("Save Generated Signal");
 
-  if (dialog.exec()) {
-    auto file = dialog.selectedFiles().first();
-    auto index = command_input->currentIndex();
-    auto widget = command_option_widgets[index];
-    auto signal = widget->generate_signal();
-    dump_file(signal, file.toStdString().c_str());
+  if (!dialog.exec()) {
+    return;
+  }
+  auto file = dialog.selectedFiles().first();
+
+  cancel_requested = false;
+  progress_bar->setValue(0);
+  progress_bar->show();
+  cancel_btn->setEnabled(true);
+  cancel_btn->show();
+  generate_btn->setEnabled(false);
+
+  worker = QThread::create([this, job, file] {
+    QString error;
+    bool done = false;
+    // Progress only moves when the sink flushes, so this posts at most one
+    // update per buffer-full.
+    uint64_t last = 0;
+    auto progress = [this, &last](uint64_t written, uint64_t total) {
+      if (written == last) {
+        return;
+      }
+      last = written;
+      int value = total ? static_cast<int>(written * 1000 / total) : 1000;
+      QMetaObject::invokeMethod(progress_bar, [this, value] { progress_bar->setValue(value); }, Qt::QueuedConnection);
+    };
+    try {
+      done = write_job(job, file.toStdString(), cancel_requested, progress);
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+    if (!done) {
+      QFile::remove(file);
+    }
+    QMetaObject::invokeMethod(this, [this, file, error, done] { finish_generation(file, error, done); },
+                              Qt::QueuedConnection);
+  });
+  worker->start();
+}
+
+void MainWindow::cancel() {
+  cancel_requested = true;
+  cancel_btn->setEnabled(false);
+}
+
+void MainWindow::finish_generation(const QString& file, const QString& error, bool done) {
+  if (!worker) {
+    return;
+  }
+  worker->wait();
+  delete worker;
+  worker = nullptr;
+  progress_bar->hide();
+  cancel_btn->hide();
+  generate_btn->setEnabled(true);
+
+  if (!error.isEmpty()) {
+    QMessageBox::critical(this, "Error", "Failed to generate " + file + ": " + error);
+  } else if (done) {
     QMessageBox msgBox;
     msgBox.setText("Signal generated successfully!");
     msgBox.exec();
   }
 }
 
+void MainWindow::closeEvent(QCloseEvent* event) {
+  if (worker) {
+    cancel_requested = true;
+    worker->wait();
+    delete worker;
+    worker = nullptr;
+  }
+  QMainWindow::closeEvent(event);
+}
+
+void MainWindow::update_preview() {
+  try {
+    auto job = command_option_widgets[command_input->currentIndex()]->make_job();
+    RleWave wave;
+    RleSink sink(wave);
+    job(sink);
+    preview->set_wave(std::make_shared<const LevelPyramid>(wave));
+  } catch (const std::exception& e) {
+    preview->set_message(e.what());
+  }
+}
+
 void MainWindow::handle_command_change(int index) {
   qDebug() << "Command changed to: " << command_input->itemText(index);
   auto widget = command_option_widgets[index];
@@ -76,9 +214,101 @@ void MainWindow::handle_command_change(int index) {
     options_widget_wrapper->addWidget(widget, 0, Qt::AlignLeft);
   }
 
+  update_preview();
   update();
 };
 
+WavePreview::WavePreview(double samp_rate, QWidget* parent) : QWidget(parent), samp_rate(samp_rate) {
+  setMinimumHeight(120);
+}
+
+void WavePreview::set_wave(std::shared_ptr<const LevelPyramid> wave) {
+  pyramid = std::move(wave);
+  message.clear();
+  view_begin = 0;
+  view_end = static_cast<double>(pyramid->size());
+  update();
+}
+
+void WavePreview::set_message(const QString& text) {
+  pyramid.reset();
+  message = text;
+  update();
+}
+
+// Keep the view inside the waveform and at least a few samples wide.
+void WavePreview::set_view(double begin, double end) {
+  double total = pyramid ? static_cast<double>(pyramid->size()) : 0;
+  double range = std::clamp(end - begin, std::min(8.0, total), total);
+  begin = std::clamp(begin, 0.0, total - range);
+  view_begin = begin;
+  view_end = begin + range;
+  update();
+}
+
+void WavePreview::paintEvent(QPaintEvent*) {
+  QPainter painter(this);
+  painter.fillRect(rect(), palette().base());
+  painter.setPen(palette().color(QPalette::Text));
+  if (!pyramid || pyramid->size() == 0) {
+    painter.drawText(rect(), Qt::AlignCenter | Qt::TextWordWrap, message);
+    return;
+  }
+
+  auto label_height = fontMetrics().height() + 4;
+  int top = 4;
+  int bottom = height() - label_height;
+  auto y = [&](uint8_t level) { return level ? top : bottom; };
+  pyramid->columns(view_begin, view_end, width(), spans);
+  QVector<QLine> lines;
+  lines.reserve(width());
+  for (int c = 0; c < width(); ++c) {
+    if (!spans[c].empty()) {
+      lines.append(QLine(c, y(spans[c].hi), c, y(spans[c].lo)));
+    }
+  }
+  painter.drawLines(lines);
+
+  auto us = [&](double samples) { return QString::number(samples / samp_rate * 1e6, 'f', 1); };
+  painter.drawText(QRect(4, bottom, width() - 8, label_height), Qt::AlignLeft | Qt::AlignVCenter,
+                   us(view_begin) + " us");
+  painter.drawText(QRect(4, bottom, width() - 8, label_height), Qt::AlignRight | Qt::AlignVCenter,
+                   us(view_end) + " us");
+}
+
+void WavePreview::wheelEvent(QWheelEvent* event) {
+  if (!pyramid) {
+    return;
+  }
+  double factor = std::pow(0.8, event->angleDelta().y() / 120.0);
+  double anchor = view_begin + event->position().x() / width() * (view_end - view_begin);
+  set_view(anchor - (anchor - view_begin) * factor, anchor + (view_end - anchor) * factor);
+  event->accept();
+}
+
+void WavePreview::mousePressEvent(QMouseEvent* event) {
+  if (event->button() == Qt::LeftButton) {
+    drag_x = event->position().x();
+  }
+}
+
+void WavePreview::mouseMoveEvent(QMouseEvent* event) {
+  if (!drag_x || !pyramid) {
+    return;
+  }
+  double shift = (*drag_x - event->position().x()) / width() * (view_end - view_begin);
+  drag_x = event->position().x();
+  set_view(view_begin + shift, view_end + shift);
+}
+
+void WavePreview::mouseReleaseEvent(QMouseEvent*) { drag_x.reset(); }
+
+void WavePreview::mouseDoubleClickEvent(QMouseEvent*) {
+  if (pyramid) {
+    set_view(0, static_cast<double>(pyramid->size()));
+  }
+}
+
 SelectOptionsWidget::SelectOptionsWidget(QWidget* parent) : CommandOptionsWidget(parent) {
   auto layout = new QFormLayout(this);
   target_input = new QComboBox(this);
@@ -118,18 +348,19 @@ SelectOptionsWidget::SelectOptionsWidget(QWidget* parent) : CommandOptionsWidget
   layout->addRow("Truncate", trunc_input);
 }
 
-std::vector<int> SelectOptionsWidget::generate_signal() {
-  auto pie = PulseIntervalEncoder{2000000};
-  auto reader = RFIDReaderCommand{&pie};
+WaveJob SelectOptionsWidget::make_job() {
+  auto reader = RFIDReaderCommand{std::make_shared<PulseIntervalEncoder>(2000000)};
   auto pointer = pointer_input->text().toInt();
   auto length = length_input->text().toInt();
   auto mask_ = hex_to_bits(mask_input->text());
-  auto mask = std::vector<int>(mask_.begin(), mask_.end());
+  auto mask = BitBuffer(std::vector<int>(mask_.begin(), mask_.end()));
   auto trunc = trunc_input->isChecked();
   auto target = target_input->currentData().value<target_t>();
   auto action = action_input->currentData().value<uint8_t>();
   auto mem_bank = mem_bank_input->currentData().value<membank_t>();
-  return reader.select(pointer, length, mask, trunc, target, action, mem_bank);
+  return [=](WaveSink& sink) {
+    reader.select(sink, pointer, static_cast<uint8_t>(length), mask, trunc, target, action, mem_bank);
+  };
 }
 
 QueryOptionsWidget::QueryOptionsWidget(QWidget* parent) : CommandOptionsWidget(parent) {
@@ -141,6 +372,7 @@ QueryOptionsWidget::QueryOptionsWidget(QWidget* parent) : CommandOptionsWidget(p
   session_input = new QComboBox(this);
   target_input = new QComboBox(this);
   q_input = new QLineEdit(this);
+  blf_input = new QLineEdit("40", this);
 
   dr_input->addItem("8", QVariant::fromValue(dr_t::DR_8));
   dr_input->addItem("64/3", QVariant::fromValue(dr_t::DR_64_3));
@@ -169,11 +401,11 @@ QueryOptionsWidget::QueryOptionsWidget(QWidget* parent) : CommandOptionsWidget(p
   layout->addRow("Session", session_input);
   layout->addRow("Target", target_input);
   layout->addRow("Q", q_input);
+  layout->addRow("BLF (kHz)", blf_input);
 }
 
-std::vector<int> QueryOptionsWidget::generate_signal() {
-  auto pie = PulseIntervalEncoder{2000000};
-  auto reader = RFIDReaderCommand{&pie};
+WaveJob QueryOptionsWidget::make_job() {
+  auto reader = RFIDReaderCommand{std::make_shared<PulseIntervalEncoder>(2000000), blf_input->text().toDouble() * 1000};
   auto dr = dr_input->currentData().value<dr_t>();
   auto miller = miller_input->currentData().value<miller_t>();
   auto trext = trext_input->isChecked();
@@ -181,7 +413,7 @@ std::vector<int> QueryOptionsWidget::generate_signal() {
   auto session = session_input->currentData().value<session_t>();
   auto target = target_input->currentData().value<inventory_t>();
   auto q = q_input->text().toInt();
-  return reader.query(dr, miller, trext, sel, session, target, q);
+  return [=](WaveSink& sink) { reader.query(sink, dr, miller, trext, sel, session, target, q); };
 }
 
 QueryRepOptionsWidget::QueryRepOptionsWidget(QWidget* parent) : CommandOptionsWidget(parent) {
@@ -196,11 +428,10 @@ QueryRepOptionsWidget::QueryRepOptionsWidget(QWidget* parent) : CommandOptionsWi
   layout->addRow("Session", session_input);
 }
 
-std::vector<int> QueryRepOptionsWidget::generate_signal() {
-  auto pie = PulseIntervalEncoder{2000000};
-  auto reader = RFIDReaderCommand{&pie};
+WaveJob QueryRepOptionsWidget::make_job() {
+  auto reader = RFIDReaderCommand{std::make_shared<PulseIntervalEncoder>(2000000)};
   auto session = session_input->currentData().value<session_t>();
-  return reader.query_rep(session);
+  return [=](WaveSink& sink) { reader.query_rep(sink, session); };
 }
 
 QueryAdjustOptionsWidget::QueryAdjustOptionsWidget(QWidget* parent) : CommandOptionsWidget(parent) {
@@ -221,12 +452,11 @@ QueryAdjustOptionsWidget::QueryAdjustOptionsWidget(QWidget* parent) : CommandOpt
   layout->addRow("UpDn", updn_input);
 }
 
-std::vector<int> QueryAdjustOptionsWidget::generate_signal() {
-  auto pie = PulseIntervalEncoder{2000000};
-  auto reader = RFIDReaderCommand{&pie};
+WaveJob QueryAdjustOptionsWidget::make_job() {
+  auto reader = RFIDReaderCommand{std::make_shared<PulseIntervalEncoder>(2000000)};
   auto session = session_input->currentData().value<session_t>();
   auto updn = updn_input->currentData().value<updn_t>();
-  return reader.query_adjust(session, updn);
+  return [=](WaveSink& sink) { reader.query_adjust(sink, session, updn); };
 }
 
 AckOptionsWidget::AckOptionsWidget(QWidget* parent) : CommandOptionsWidget(parent) {
@@ -235,12 +465,11 @@ AckOptionsWidget::AckOptionsWidget(QWidget* parent) : CommandOptionsWidget(paren
   layout->addRow("RN16", rn16_input);
 }
 
-std::vector<int> AckOptionsWidget::generate_signal() {
-  auto pie = PulseIntervalEncoder{2000000};
-  auto reader = RFIDReaderCommand{&pie};
+WaveJob AckOptionsWidget::make_job() {
+  auto reader = RFIDReaderCommand{std::make_shared<PulseIntervalEncoder>(2000000)};
   auto rn16_ = bin_to_bits(rn16_input->text());
-  auto rn16 = std::vector<int>(rn16_.begin(), rn16_.end());
-  return reader.ack(rn16);
+  auto rn16 = BitBuffer(std::vector<int>(rn16_.begin(), rn16_.end()));
+  return [=](WaveSink& sink) { reader.ack(sink, rn16); };
 }
 
 QVector<int> hex_to_bits(const QString& hex) {
@@ -1,14 +1,20 @@
 #pragma once
 
 #include <QtWidgets>
+#include <atomic>
+#include <memory>
+#include <optional>
 #include <vector>
 
-enum class command_t { SELECT, QUERY, QUERY_REP, QUERY_ADJUST, ACK };
+#include "batch.hpp"
+#include "preview.hpp"
+#include "reader.hpp"
 
 class CommandOptionsWidget : public QWidget {
  public:
   CommandOptionsWidget(QWidget* parent = nullptr) : QWidget(parent) {}
-  virtual std::vector<int> generate_signal() = 0;
+  // Read the inputs (on the UI thread) into a job that can run on any thread.
+  virtual WaveJob make_job() = 0;
 };
 
 class SelectOptionsWidget : public CommandOptionsWidget {
@@ -24,7 +30,7 @@ class SelectOptionsWidget : public CommandOptionsWidget {
  public:
   SelectOptionsWidget(QWidget* parent = nullptr);
 
-  std::vector<int> generate_signal() override;
+  WaveJob make_job() override;
 };
 
 class QueryOptionsWidget : public CommandOptionsWidget {
@@ -36,11 +42,12 @@ class QueryOptionsWidget : public CommandOptionsWidget {
   QComboBox* session_input;
   QComboBox* target_input;
   QLineEdit* q_input;
+  QLineEdit* blf_input;
 
  public:
   QueryOptionsWidget(QWidget* parent = nullptr);
 
-  std::vector<int> generate_signal() override;
+  WaveJob make_job() override;
 };
 
 class QueryRepOptionsWidget : public CommandOptionsWidget {
@@ -50,7 +57,7 @@ class QueryRepOptionsWidget : public CommandOptionsWidget {
  public:
   QueryRepOptionsWidget(QWidget* parent = nullptr);
 
-  std::vector<int> generate_signal() override;
+  WaveJob make_job() override;
 };
 
 class QueryAdjustOptionsWidget : public CommandOptionsWidget {
@@ -61,7 +68,7 @@ class QueryAdjustOptionsWidget : public CommandOptionsWidget {
  public:
   QueryAdjustOptionsWidget(QWidget* parent = nullptr);
 
-  std::vector<int> generate_signal() override;
+  WaveJob make_job() override;
 };
 
 class AckOptionsWidget : public CommandOptionsWidget {
@@ -71,7 +78,40 @@ class AckOptionsWidget : public CommandOptionsWidget {
  public:
   AckOptionsWidget(QWidget* parent = nullptr);
 
-  std::vector<int> generate_signal() override;
+  WaveJob make_job() override;
+};
+
+// Plots a waveform through its LevelPyramid, so a repaint costs one span
+// lookup per pixel column at any zoom. The wheel zooms around the cursor,
+// dragging pans and a double click shows the whole waveform.
+class WavePreview : public QWidget {
+ private:
+  std::shared_ptr<const LevelPyramid> pyramid;
+  QString message;
+  double samp_rate;
+  // Visible range in samples; fractional when zoomed past one sample per
+  // pixel.
+  double view_begin = 0;
+  double view_end = 0;
+  std::optional<double> drag_x;
+  std::vector<LevelSpan> spans;
+
+  void set_view(double begin, double end);
+
+ protected:
+  void paintEvent(QPaintEvent* event) override;
+  void wheelEvent(QWheelEvent* event) override;
+  void mousePressEvent(QMouseEvent* event) override;
+  void mouseMoveEvent(QMouseEvent* event) override;
+  void mouseReleaseEvent(QMouseEvent* event) override;
+  void mouseDoubleClickEvent(QMouseEvent* event) override;
+
+ public:
+  WavePreview(double samp_rate, QWidget* parent = nullptr);
+
+  void set_wave(std::shared_ptr<const LevelPyramid> wave);
+  // Show text instead of a waveform, e.g. why the inputs cannot be encoded.
+  void set_message(const QString& text);
 };
 
 class MainWindow : public QMainWindow {
@@ -79,15 +119,28 @@ class MainWindow : public QMainWindow {
   QWidget* central_widget;
   QComboBox* command_input;
   QPushButton* generate_btn;
+  QPushButton* cancel_btn;
+  QProgressBar* progress_bar;
+  WavePreview* preview;
   QVBoxLayout* options_widget_wrapper;
   QVector<QString> command_names = {"Select", "Query", "QueryRep", "QueryAdjust", "Ack"};
   QVector<CommandOptionsWidget*> command_option_widgets;
+  // Writes the output file while the window stays responsive.
+  QThread* worker = nullptr;
+  std::atomic<bool> cancel_requested{false};
+
+  void finish_generation(const QString& file, const QString& error, bool done);
+
+ protected:
+  void closeEvent(QCloseEvent* event) override;
 
  public:
   MainWindow();
 
  public slots:
   void generate();
+  void cancel();
+  void update_preview();
   void handle_command_change(int index);
 };
 
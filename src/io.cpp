@@ -0,0 +1,338 @@
+#include "io.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "stats.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+template <typename T>
+void dump_file(const std::vector<T>& data, const char* path) {
+  FileSink sink(path);
+  if constexpr (std::is_same_v<T, uint8_t>) {
+    sink.write(data.data(), data.size());
+  } else {
+    uint8_t block[4096];
+    for (size_t i = 0; i < data.size(); i += sizeof(block)) {
+      size_t n = std::min(sizeof(block), data.size() - i);
+      for (size_t j = 0; j < n; j++) {
+        block[j] = data[i + j] != 0;
+      }
+      sink.write(block, n);
+    }
+  }
+  sink.close();
+}
+
+template void dump_file<uint8_t>(const std::vector<uint8_t>&, const char*);
+template void dump_file<int16_t>(const std::vector<int16_t>&, const char*);
+template void dump_file<float>(const std::vector<float>&, const char*);
+
+FileSink::FileSink(const std::string& path, iq_format_t format, Modulation modulation, size_t buffer_bytes)
+    : file(path, std::ios::binary), converter(format, modulation) {
+  if (!file) {
+    throw std::runtime_error("Cannot open output file: " + path);
+  }
+  if (Modulator::needed(modulation)) {
+    modulator = std::make_unique<Modulator>(format, modulation);
+  }
+  // Room for the samples a modulator releases on close.
+  capacity = std::max<size_t>(buffer_bytes / converter.sample_size(), Modulator::hilbert_half);
+  buffer.resize(capacity * converter.sample_size());
+  EPCPHY_BUFFER(buffer.size());
+}
+
+FileSink::FileSink(const std::string& path, Modulation modulation)
+    : FileSink(path, iq_format_from_path(path), modulation) {}
+
+FileSink::~FileSink() {
+  if (file.is_open()) {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+}
+
+// Level-to-envelope staging for the modulator path.
+static constexpr size_t envelope_block = 4096;
+
+void FileSink::write(const uint8_t* levels, size_t n) {
+  if (modulator) {
+    float envelope[envelope_block];
+    for (size_t i = 0; i < n; i += envelope_block) {
+      size_t m = std::min(envelope_block, n - i);
+      for (size_t j = 0; j < m; ++j) {
+        envelope[j] = levels[i + j] ? 1.0f : 0.0f;
+      }
+      write_envelope(envelope, m);
+    }
+    return;
+  }
+  while (n > 0) {
+    if (used == capacity) {
+      flush();
+    }
+    size_t chunk = std::min(n, capacity - used);
+    converter.convert(levels, chunk, buffer.data() + used * converter.sample_size());
+    used += chunk;
+    levels += chunk;
+    n -= chunk;
+  }
+}
+
+void FileSink::fill(uint8_t level, size_t n) {
+  if (modulator) {
+    float envelope[envelope_block];
+    std::fill_n(envelope, envelope_block, level ? 1.0f : 0.0f);
+    for (size_t i = 0; i < n; i += envelope_block) {
+      write_envelope(envelope, std::min(envelope_block, n - i));
+    }
+    return;
+  }
+  while (n > 0) {
+    if (used == capacity) {
+      flush();
+    }
+    size_t chunk = std::min(n, capacity - used);
+    converter.fill(level, chunk, buffer.data() + used * converter.sample_size());
+    used += chunk;
+    n -= chunk;
+  }
+}
+
+void FileSink::write_runs(const Run* runs, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    fill(runs[i].level, runs[i].length);
+  }
+}
+
+void FileSink::write_envelope(const float* envelope, size_t n) {
+  while (n > 0) {
+    if (used == capacity) {
+      flush();
+    }
+    size_t chunk = std::min(n, capacity - used);
+    auto out = buffer.data() + used * converter.sample_size();
+    if (modulator) {
+      used += modulator->process(envelope, chunk, out);
+    } else {
+      converter.convert_envelope(envelope, chunk, out);
+      used += chunk;
+    }
+    envelope += chunk;
+    n -= chunk;
+  }
+}
+
+void FileSink::flush() {
+  EPCPHY_STAGE(stage_t::WRITE);
+  EPCPHY_COUNT(stage_t::WRITE, used, used * converter.sample_size());
+  file.write(reinterpret_cast<const char*>(buffer.data()), used * converter.sample_size());
+  written += used * converter.sample_size();
+  used = 0;
+  if (!file) {
+    throw std::runtime_error("Failed to write output file.");
+  }
+}
+
+void FileSink::close() {
+  EPCPHY_STAGE(stage_t::WRITE);
+  if (modulator) {
+    if (capacity - used < modulator->delay()) {
+      flush();
+    }
+    used += modulator->finish(buffer.data() + used * converter.sample_size());
+  }
+  flush();
+  file.close();
+  if (!file) {
+    throw std::runtime_error("Failed to close output file.");
+  }
+}
+
+MappedOutput::~MappedOutput() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                     FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    file = nullptr;
+    throw std::runtime_error("Cannot open input file: " + path);
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    throw std::runtime_error("Cannot read the size of: " + path);
+  }
+  length = static_cast<size_t>(size.QuadPart);
+  if (length == 0) {
+    return;
+  }
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping) {
+    bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (!bytes) {
+    if (mapping) {
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    throw std::runtime_error("Cannot map input file: " + path);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (bytes) {
+    UnmapViewOfFile(bytes);
+  }
+  if (mapping) {
+    CloseHandle(mapping);
+  }
+  if (file) {
+    CloseHandle(file);
+  }
+}
+
+MappedOutput::MappedOutput(const std::string& path, size_t size) : path(path), length(size) {
+  file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                     nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    file = nullptr;
+    throw std::runtime_error("Cannot open output file: " + path);
+  }
+  if (length == 0) {
+    return;
+  }
+  // Mapping a view of this size extends the file to it.
+  auto size64 = static_cast<uint64_t>(length);
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32),
+                               static_cast<DWORD>(size64), nullptr);
+  if (mapping) {
+    bytes = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+  }
+  if (!bytes) {
+    close();
+    throw std::runtime_error("Cannot map output file: " + path);
+  }
+}
+
+void MappedOutput::close() {
+  bool ok = true;
+  if (bytes) {
+    ok = FlushViewOfFile(bytes, 0) && ok;
+    ok = UnmapViewOfFile(bytes) && ok;
+    bytes = nullptr;
+  }
+  if (mapping) {
+    CloseHandle(mapping);
+    mapping = nullptr;
+  }
+  if (file) {
+    ok = CloseHandle(file) && ok;
+    file = nullptr;
+  }
+  if (!ok) {
+    throw std::runtime_error("Failed to write output file: " + path);
+  }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open input file: " + path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot read the size of: " + path);
+  }
+  length = static_cast<size_t>(st.st_size);
+  if (length > 0) {
+    void* map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Cannot map input file: " + path);
+    }
+    madvise(map, length, MADV_SEQUENTIAL);
+    bytes = static_cast<const uint8_t*>(map);
+  }
+  // The mapping keeps the file referenced.
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (bytes) {
+    munmap(const_cast<uint8_t*>(bytes), length);
+  }
+}
+
+MappedOutput::MappedOutput(const std::string& path, size_t size) : path(path), length(size) {
+  fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open output file: " + path);
+  }
+  if (length == 0) {
+    return;
+  }
+  auto size_off = static_cast<off_t>(length);
+  // posix_fallocate is not supported everywhere (e.g. some network file
+  // systems); ftruncate alone still gives a sparse file of the right size.
+  int reserved = -1;
+#ifdef __linux__
+  reserved = posix_fallocate(fd, 0, size_off);
+  if (reserved == ENOSPC) {
+    close();
+    throw std::runtime_error("Not enough space for output file: " + path);
+  }
+#endif
+  if (reserved != 0 && ftruncate(fd, size_off) != 0) {
+    close();
+    throw std::runtime_error("Cannot resize output file: " + path);
+  }
+  void* map = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close();
+    throw std::runtime_error("Cannot map output file: " + path);
+  }
+  bytes = static_cast<uint8_t*>(map);
+}
+
+void MappedOutput::close() {
+  bool ok = true;
+  if (bytes) {
+    ok = munmap(bytes, length) == 0 && ok;
+    bytes = nullptr;
+  }
+  if (fd >= 0) {
+    ok = ::close(fd) == 0 && ok;
+    fd = -1;
+  }
+  if (!ok) {
+    throw std::runtime_error("Failed to write output file: " + path);
+  }
+}
+
+#endif
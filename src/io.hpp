@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "iq.hpp"
+#include "modulator.hpp"
+#include "sink.hpp"
+
+// Write a level waveform to path, in the IQ format given by its suffix.
+template <typename T>
+void dump_file(const std::vector<T>& data, const char* path);
+
+// Streams levels to an IQ file through a large fixed-size buffer. Whole spans
+// and runs are converted straight into the buffer, which is written with one
+// call per buffer-full, so the memory footprint does not depend on the length
+// of the waveform. Schemes other than baseband DSB go through a Modulator.
+class FileSink : public WaveSink {
+ public:
+  static constexpr size_t default_buffer_bytes = 4 << 20;
+
+  FileSink(const std::string& path, iq_format_t format, Modulation modulation = {},
+           size_t buffer_bytes = default_buffer_bytes);
+  // Format chosen from the file suffix.
+  explicit FileSink(const std::string& path, Modulation modulation = {});
+  ~FileSink() override;
+
+  void write(const uint8_t* levels, size_t n) override;
+  void fill(uint8_t level, size_t n) override;
+  void write_runs(const Run* runs, size_t n) override;
+  // Append shaped samples (see PulseShaper) instead of levels.
+  void write_envelope(const float* envelope, size_t n);
+
+  // Flush buffered samples and close the file, reporting write errors.
+  void close();
+  // Bytes handed to the file so far, excluding what is still buffered.
+  uint64_t bytes_written() const { return written; }
+
+ private:
+  void flush();
+
+  std::ofstream file;
+  IQConverter converter;
+  std::unique_ptr<Modulator> modulator;
+  std::vector<uint8_t> buffer;
+  size_t capacity;
+  size_t used = 0;
+  uint64_t written = 0;
+};
+
+// Read-only memory map of a whole file, for scanning captures that are too
+// large to load. Pages are faulted in on access and hinted as sequential.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const { return bytes; }
+  size_t size() const { return length; }
+
+ private:
+  const uint8_t* bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void* file = nullptr;
+  void* mapping = nullptr;
+#endif
+};
+
+// Writable shared mapping of an output file created at its final size, so
+// that threads can fill disjoint ranges of it concurrently. The blocks are
+// reserved up front where the file system supports it, so running out of
+// space fails here rather than on a page fault mid-write.
+class MappedOutput {
+ public:
+  MappedOutput(const std::string& path, size_t size);
+  ~MappedOutput();
+  MappedOutput(const MappedOutput&) = delete;
+  MappedOutput& operator=(const MappedOutput&) = delete;
+
+  uint8_t* data() { return bytes; }
+  size_t size() const { return length; }
+
+  // Unmap and close the file, reporting errors.
+  void close();
+
+ private:
+  std::string path;
+  uint8_t* bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void* file = nullptr;
+  void* mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+};
@@ -0,0 +1,348 @@
+#include "iq.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EPCPHY_X86 1
+#include <immintrin.h>
+#endif
+
+size_t iq_sample_size(iq_format_t format) {
+  switch (format) {
+    case iq_format_t::CF32:
+      return 8;
+    case iq_format_t::CS16:
+      return 4;
+    case iq_format_t::CS8:
+    case iq_format_t::CU8:
+      return 2;
+  }
+  throw std::invalid_argument("Unknown IQ format.");
+}
+
+iq_format_t iq_format_from_name(const std::string& name) {
+  std::string n;
+  for (char c : name) {
+    n.push_back(std::tolower(static_cast<unsigned char>(c)));
+  }
+  if (n == "cf32" || n == "fc32" || n == "cfile") {
+    return iq_format_t::CF32;
+  }
+  if (n == "cs16" || n == "sc16") {
+    return iq_format_t::CS16;
+  }
+  if (n == "cs8" || n == "sc8") {
+    return iq_format_t::CS8;
+  }
+  if (n == "cu8") {
+    return iq_format_t::CU8;
+  }
+  throw std::invalid_argument("Unknown IQ format: " + name);
+}
+
+iq_format_t iq_format_from_path(const std::string& path) {
+  auto dot = path.find_last_of('.');
+  auto slash = path.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return iq_format_t::CF32;
+  }
+  try {
+    return iq_format_from_name(path.substr(dot + 1));
+  } catch (const std::invalid_argument&) {
+    return iq_format_t::CF32;
+  }
+}
+
+static uint64_t make_sample(iq_format_t format, float value) {
+  uint64_t sample = 0;
+  switch (format) {
+    case iq_format_t::CF32: {
+      float iq[2] = {value, 0.0f};
+      std::memcpy(&sample, iq, sizeof(iq));
+      break;
+    }
+    case iq_format_t::CS16: {
+      int16_t iq[2] = {static_cast<int16_t>(std::lrint(std::fmax(-1.0f, std::fmin(1.0f, value)) * 32767)), 0};
+      std::memcpy(&sample, iq, sizeof(iq));
+      break;
+    }
+    case iq_format_t::CS8: {
+      int8_t iq[2] = {static_cast<int8_t>(std::lrint(std::fmax(-1.0f, std::fmin(1.0f, value)) * 127)), 0};
+      std::memcpy(&sample, iq, sizeof(iq));
+      break;
+    }
+    case iq_format_t::CU8: {
+      uint8_t iq[2] = {static_cast<uint8_t>(128 + std::lrint(std::fmax(-1.0f, std::fmin(1.0f, value)) * 127)), 128};
+      std::memcpy(&sample, iq, sizeof(iq));
+      break;
+    }
+  }
+  return sample;
+}
+
+IQConverter::IQConverter(iq_format_t format, Modulation modulation)
+    : fmt(format),
+      unit(iq_sample_size(format)),
+      lo_amp(modulation.amplitude * (1.0f - modulation.depth)),
+      hi_amp(modulation.amplitude) {
+  hi = make_sample(format, hi_amp);
+  lo = make_sample(format, lo_amp);
+}
+
+// Scalar fallback, also used for the tails of the vector loops.
+
+template <size_t U>
+static void convert_scalar(const uint8_t* levels, size_t n, uint8_t* out, uint64_t lo, uint64_t hi) {
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t sample = levels[i] ? hi : lo;
+    std::memcpy(out + i * U, &sample, U);
+  }
+}
+
+template <size_t U>
+static void fill_scalar(size_t n, uint8_t* out, uint64_t sample) {
+  for (size_t i = 0; i < n; ++i) {
+    std::memcpy(out + i * U, &sample, U);
+  }
+}
+
+#ifdef EPCPHY_X86
+
+template <size_t U>
+static __m128i broadcast128(uint64_t sample) {
+  if constexpr (U == 2) {
+    return _mm_set1_epi16(static_cast<int16_t>(sample));
+  } else if constexpr (U == 4) {
+    return _mm_set1_epi32(static_cast<int32_t>(sample));
+  } else {
+    return _mm_set1_epi64x(static_cast<int64_t>(sample));
+  }
+}
+
+// Widen a byte mask (0xff where the level is 0) to U-byte lanes and select
+// between hi and lo: out = hi ^ (mask & (hi ^ lo)).
+template <size_t U>
+__attribute__((target("sse2"))) static void convert_sse2(const uint8_t* levels, size_t n, uint8_t* out, uint64_t lo,
+                                                         uint64_t hi) {
+  const __m128i vhi = broadcast128<U>(hi);
+  const __m128i vdiff = _mm_xor_si128(vhi, broadcast128<U>(lo));
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i m8 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(levels + i)), zero);
+    __m128i parts[8];
+    int n_parts;
+    if constexpr (U == 2) {
+      parts[0] = _mm_unpacklo_epi8(m8, m8);
+      parts[1] = _mm_unpackhi_epi8(m8, m8);
+      n_parts = 2;
+    } else {
+      __m128i a = _mm_unpacklo_epi8(m8, m8);
+      __m128i b = _mm_unpackhi_epi8(m8, m8);
+      __m128i m32[4] = {_mm_unpacklo_epi16(a, a), _mm_unpackhi_epi16(a, a), _mm_unpacklo_epi16(b, b),
+                        _mm_unpackhi_epi16(b, b)};
+      if constexpr (U == 4) {
+        for (int k = 0; k < 4; ++k) {
+          parts[k] = m32[k];
+        }
+        n_parts = 4;
+      } else {
+        for (int k = 0; k < 4; ++k) {
+          parts[2 * k] = _mm_unpacklo_epi32(m32[k], m32[k]);
+          parts[2 * k + 1] = _mm_unpackhi_epi32(m32[k], m32[k]);
+        }
+        n_parts = 8;
+      }
+    }
+    auto dst = reinterpret_cast<__m128i*>(out + i * U);
+    for (int k = 0; k < n_parts; ++k) {
+      _mm_storeu_si128(dst + k, _mm_xor_si128(vhi, _mm_and_si128(parts[k], vdiff)));
+    }
+  }
+  convert_scalar<U>(levels + i, n - i, out + i * U, lo, hi);
+}
+
+template <size_t U>
+__attribute__((target("sse2"))) static void fill_sse2(size_t n, uint8_t* out, uint64_t sample) {
+  const __m128i v = broadcast128<U>(sample);
+  const size_t per_vec = 16 / U;
+  size_t i = 0;
+  for (; i + 4 * per_vec <= n; i += 4 * per_vec) {
+    auto dst = reinterpret_cast<__m128i*>(out + i * U);
+    _mm_storeu_si128(dst, v);
+    _mm_storeu_si128(dst + 1, v);
+    _mm_storeu_si128(dst + 2, v);
+    _mm_storeu_si128(dst + 3, v);
+  }
+  fill_scalar<U>(n - i, out + i * U, sample);
+}
+
+template <size_t U>
+__attribute__((target("avx2"))) static __m256i widen_mask_avx2(__m128i m8) {
+  if constexpr (U == 2) {
+    return _mm256_cvtepi8_epi16(m8);
+  } else if constexpr (U == 4) {
+    return _mm256_cvtepi8_epi32(m8);
+  } else {
+    return _mm256_cvtepi8_epi64(m8);
+  }
+}
+
+template <size_t U>
+__attribute__((target("avx2"))) static __m256i broadcast256(uint64_t sample) {
+  if constexpr (U == 2) {
+    return _mm256_set1_epi16(static_cast<int16_t>(sample));
+  } else if constexpr (U == 4) {
+    return _mm256_set1_epi32(static_cast<int32_t>(sample));
+  } else {
+    return _mm256_set1_epi64x(static_cast<int64_t>(sample));
+  }
+}
+
+// Same select as the SSE2 kernel; the sign-extending converts widen 16, 8 or
+// 4 mask bytes into one 256-bit vector of U-byte lanes.
+template <size_t U>
+__attribute__((target("avx2"))) static void convert_avx2(const uint8_t* levels, size_t n, uint8_t* out, uint64_t lo,
+                                                         uint64_t hi) {
+  const __m256i vhi = broadcast256<U>(hi);
+  const __m256i vdiff = _mm256_xor_si256(vhi, broadcast256<U>(lo));
+  const __m128i zero = _mm_setzero_si128();
+  constexpr size_t lanes = 32 / U;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i m8 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(levels + i)), zero);
+    auto dst = reinterpret_cast<__m256i*>(out + i * U);
+    for (size_t k = 0; k < 16 / lanes; ++k) {
+      __m256i mask = widen_mask_avx2<U>(m8);
+      _mm256_storeu_si256(dst + k, _mm256_xor_si256(vhi, _mm256_and_si256(mask, vdiff)));
+      if constexpr (lanes == 8) {
+        m8 = _mm_srli_si128(m8, 8);
+      } else if constexpr (lanes == 4) {
+        m8 = _mm_srli_si128(m8, 4);
+      }
+    }
+  }
+  convert_scalar<U>(levels + i, n - i, out + i * U, lo, hi);
+}
+
+template <size_t U>
+__attribute__((target("avx2"))) static void fill_avx2(size_t n, uint8_t* out, uint64_t sample) {
+  const __m256i v = broadcast256<U>(sample);
+  const size_t per_vec = 32 / U;
+  size_t i = 0;
+  for (; i + 4 * per_vec <= n; i += 4 * per_vec) {
+    auto dst = reinterpret_cast<__m256i*>(out + i * U);
+    _mm256_storeu_si256(dst, v);
+    _mm256_storeu_si256(dst + 1, v);
+    _mm256_storeu_si256(dst + 2, v);
+    _mm256_storeu_si256(dst + 3, v);
+  }
+  fill_sse2<U>(n - i, out + i * U, sample);
+}
+
+static bool has_avx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+
+#endif
+
+template <size_t U>
+static void convert_dispatch(const uint8_t* levels, size_t n, uint8_t* out, uint64_t lo, uint64_t hi) {
+#ifdef EPCPHY_X86
+  if (has_avx2()) {
+    convert_avx2<U>(levels, n, out, lo, hi);
+  } else {
+    convert_sse2<U>(levels, n, out, lo, hi);
+  }
+#else
+  convert_scalar<U>(levels, n, out, lo, hi);
+#endif
+}
+
+template <size_t U>
+static void fill_dispatch(size_t n, uint8_t* out, uint64_t sample) {
+#ifdef EPCPHY_X86
+  if (has_avx2()) {
+    fill_avx2<U>(n, out, sample);
+  } else {
+    fill_sse2<U>(n, out, sample);
+  }
+#else
+  fill_scalar<U>(n, out, sample);
+#endif
+}
+
+void IQConverter::convert(const uint8_t* levels, size_t n, void* out) const {
+  auto dst = static_cast<uint8_t*>(out);
+  switch (unit) {
+    case 2:
+      convert_dispatch<2>(levels, n, dst, lo, hi);
+      break;
+    case 4:
+      convert_dispatch<4>(levels, n, dst, lo, hi);
+      break;
+    default:
+      convert_dispatch<8>(levels, n, dst, lo, hi);
+      break;
+  }
+}
+
+void IQConverter::fill(uint8_t level, size_t n, void* out) const {
+  auto dst = static_cast<uint8_t*>(out);
+  uint64_t sample = level ? hi : lo;
+  switch (unit) {
+    case 2:
+      fill_dispatch<2>(n, dst, sample);
+      break;
+    case 4:
+      fill_dispatch<4>(n, dst, sample);
+      break;
+    default:
+      fill_dispatch<8>(n, dst, sample);
+      break;
+  }
+}
+
+void IQConverter::expand(const Run* runs, size_t n_runs, void* out) const {
+  auto dst = static_cast<uint8_t*>(out);
+  for (size_t i = 0; i < n_runs; ++i) {
+    fill(runs[i].level, runs[i].length, dst);
+    dst += runs[i].length * unit;
+  }
+}
+
+template <typename S>
+static void convert_envelope_as(const float* envelope, size_t n, S* out, float lo, float hi, float scale,
+                                float offset) {
+  for (size_t i = 0; i < n; ++i) {
+    float v = std::fmax(-1.0f, std::fmin(1.0f, lo + (hi - lo) * envelope[i]));
+    out[2 * i] = static_cast<S>(std::lrint(v * scale + offset));
+    out[2 * i + 1] = static_cast<S>(offset);
+  }
+}
+
+void IQConverter::convert_envelope(const float* envelope, size_t n, void* out) const {
+  switch (fmt) {
+    case iq_format_t::CF32: {
+      auto dst = static_cast<float*>(out);
+      for (size_t i = 0; i < n; ++i) {
+        dst[2 * i] = lo_amp + (hi_amp - lo_amp) * envelope[i];
+        dst[2 * i + 1] = 0.0f;
+      }
+      break;
+    }
+    case iq_format_t::CS16:
+      convert_envelope_as(envelope, n, static_cast<int16_t*>(out), lo_amp, hi_amp, 32767, 0);
+      break;
+    case iq_format_t::CS8:
+      convert_envelope_as(envelope, n, static_cast<int8_t*>(out), lo_amp, hi_amp, 127, 0);
+      break;
+    case iq_format_t::CU8:
+      convert_envelope_as(envelope, n, static_cast<uint8_t*>(out), lo_amp, hi_amp, 127, 128);
+      break;
+  }
+}
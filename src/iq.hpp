@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "sink.hpp"
+
+// Interleaved IQ sample formats: complex float32, int16, int8 and offset
+// binary uint8 (zero at 128, as used by RTL-SDR style tools).
+enum class iq_format_t { CF32, CS16, CS8, CU8 };
+
+// Carrier modulation. DSB keys the amplitude of a real envelope; SSB adds
+// the Hilbert transform of the envelope as the quadrature component, which
+// suppresses one sideband; PR reverses the carrier phase at every PIE
+// symbol.
+enum class modulation_t { DSB, SSB, PR };
+
+// Amplitude of the two PIE levels: level 1 maps to amplitude, level 0 to
+// amplitude * (1 - depth), both relative to the full scale of the format.
+// if_offset shifts the result to an IF with an NCO, in cycles per sample
+// (IF / sample rate). The defaults reproduce the plain 0/1 envelope.
+struct Modulation {
+  float amplitude = 1.0f;
+  float depth = 1.0f;
+  modulation_t scheme = modulation_t::DSB;
+  double if_offset = 0;
+};
+
+size_t iq_sample_size(iq_format_t format);
+// Parse a format name such as "cs16" (case-insensitive).
+iq_format_t iq_format_from_name(const std::string& name);
+// Pick the format from a file suffix (.cf32/.fc32/.cfile, .cs16/.sc16,
+// .cs8/.sc8, .cu8); anything else is cf32.
+iq_format_t iq_format_from_path(const std::string& path);
+
+// Converts PIE levels (0 or 1) or level runs into IQ samples. Scaling is
+// folded into two precomputed samples, so conversion is a per-sample select
+// that runs as SSE2 or AVX2 blends where the CPU supports it.
+class IQConverter {
+ public:
+  IQConverter(iq_format_t format = iq_format_t::CF32, Modulation modulation = {});
+
+  iq_format_t format() const { return fmt; }
+  size_t sample_size() const { return unit; }
+
+  // Write n IQ samples to out, one for each level.
+  void convert(const uint8_t* levels, size_t n, void* out) const;
+  // Write n copies of the IQ sample for level to out.
+  void fill(uint8_t level, size_t n, void* out) const;
+  // Write the samples of n_runs runs to out, which must hold all of them.
+  void expand(const Run* runs, size_t n_runs, void* out) const;
+  // Write n IQ samples for a shaped envelope, where 0 and 1 stand for the
+  // amplitudes of level 0 and level 1.
+  void convert_envelope(const float* envelope, size_t n, void* out) const;
+
+ private:
+  iq_format_t fmt;
+  size_t unit;
+  // Amplitudes of level 0 and level 1.
+  float lo_amp;
+  float hi_amp;
+  // IQ sample for level 0 and level 1, zero-extended to 64 bits.
+  uint64_t lo;
+  uint64_t hi;
+};
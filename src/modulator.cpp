@@ -0,0 +1,164 @@
+#include "modulator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr size_t block_size = 1024;
+// M_PI needs _USE_MATH_DEFINES on MSVC.
+static constexpr double pi = 3.14159265358979323846;
+
+Modulator::Modulator(iq_format_t format, Modulation modulation)
+    : fmt(format),
+      unit(iq_sample_size(format)),
+      scheme(modulation.scheme),
+      lo(modulation.amplitude * (1.0f - modulation.depth)),
+      hi(modulation.amplitude) {
+  if (scheme == modulation_t::SSB) {
+    // Ideal response 2 / (pi k) at odd k, Blackman windowed.
+    for (size_t k = 1; k <= hilbert_half; k += 2) {
+      double x = pi * k / (hilbert_half + 1);
+      double window = 0.42 + 0.5 * std::cos(x) + 0.08 * std::cos(2 * x);
+      taps.push_back(static_cast<float>(2 / (pi * k) * window));
+    }
+  }
+  if (modulation.if_offset != 0) {
+    nco = true;
+    for (size_t k = 0; k <= nco_group; ++k) {
+      rotation.push_back(std::polar(1.0, 2 * pi * modulation.if_offset * k));
+    }
+  }
+}
+
+bool Modulator::needed(const Modulation& modulation) {
+  return modulation.scheme != modulation_t::DSB || modulation.if_offset != 0;
+}
+
+template <typename S>
+static void store_scaled(const float* i_in, const float* q_in, size_t n, S* out, float scale, float offset) {
+  for (size_t j = 0; j < n; ++j) {
+    float i = std::fmax(-1.0f, std::fmin(1.0f, i_in[j]));
+    float q = std::fmax(-1.0f, std::fmin(1.0f, q_in[j]));
+    out[2 * j] = static_cast<S>(std::lrint(i * scale + offset));
+    out[2 * j + 1] = static_cast<S>(std::lrint(q * scale + offset));
+  }
+}
+
+size_t Modulator::process(const float* envelope, size_t n, void* out) {
+  auto dst = static_cast<uint8_t*>(out);
+  size_t written = 0;
+  float baseband[block_size];
+  for (size_t i = 0; i < n; i += block_size) {
+    size_t m = std::min(block_size, n - i);
+    const float* e = envelope + i;
+    if (scheme == modulation_t::PR) {
+      // The phase reverses where the envelope falls through half scale,
+      // i.e. inside the low pulse that ends every PIE symbol.
+      for (size_t j = 0; j < m; ++j) {
+        if (prev >= 0.5f && e[j] < 0.5f) {
+          sign = -sign;
+        }
+        prev = e[j];
+        baseband[j] = sign * (lo + (hi - lo) * e[j]);
+      }
+    } else {
+      for (size_t j = 0; j < m; ++j) {
+        baseband[j] = lo + (hi - lo) * e[j];
+      }
+    }
+    written += emit(baseband, m, dst + written * unit);
+  }
+  return written;
+}
+
+size_t Modulator::finish(void* out) {
+  if (scheme != modulation_t::SSB || !primed) {
+    return 0;
+  }
+  // Continue the last sample past the end, as the first one was continued
+  // before the start.
+  float last = line.back();
+  std::vector<float> pad(hilbert_half, last);
+  size_t written = emit(pad.data(), pad.size(), static_cast<uint8_t*>(out));
+  line.clear();
+  primed = false;
+  return written;
+}
+
+size_t Modulator::run_hilbert(float* i_out, float* q_out) {
+  if (line.size() < 2 * hilbert_half + 1) {
+    return 0;
+  }
+  size_t m = line.size() - 2 * hilbert_half;
+  for (size_t c = 0; c < m; ++c) {
+    const float* x = line.data() + c + hilbert_half;
+    float q = 0;
+    for (size_t t = 0; t < taps.size(); ++t) {
+      size_t k = 2 * t + 1;
+      q += taps[t] * (x[-static_cast<ptrdiff_t>(k)] - x[k]);
+    }
+    i_out[c] = x[0];
+    q_out[c] = q;
+  }
+  line.erase(line.begin(), line.begin() + m);
+  return m;
+}
+
+size_t Modulator::emit(const float* baseband, size_t n, uint8_t* out) {
+  float i_buf[block_size];
+  float q_buf[block_size];
+  size_t m = n;
+  if (scheme == modulation_t::SSB) {
+    if (!primed) {
+      // Continue the first sample before the start.
+      line.assign(hilbert_half, baseband[0]);
+      primed = true;
+    }
+    line.insert(line.end(), baseband, baseband + n);
+    m = run_hilbert(i_buf, q_buf);
+  } else {
+    std::copy_n(baseband, n, i_buf);
+    std::fill_n(q_buf, n, 0.0f);
+  }
+
+  if (nco) {
+    for (size_t g = 0; g < m; g += nco_group) {
+      size_t len = std::min(nco_group, m - g);
+      float re[nco_group];
+      float im[nco_group];
+      for (size_t k = 0; k < len; ++k) {
+        auto r = phasor * rotation[k];
+        re[k] = static_cast<float>(r.real());
+        im[k] = static_cast<float>(r.imag());
+      }
+      for (size_t k = 0; k < len; ++k) {
+        float i = i_buf[g + k];
+        float q = q_buf[g + k];
+        i_buf[g + k] = i * re[k] - q * im[k];
+        q_buf[g + k] = i * im[k] + q * re[k];
+      }
+      phasor *= rotation[len];
+      phasor /= std::abs(phasor);
+    }
+  }
+
+  switch (fmt) {
+    case iq_format_t::CF32: {
+      auto dst = reinterpret_cast<float*>(out);
+      for (size_t j = 0; j < m; ++j) {
+        dst[2 * j] = i_buf[j];
+        dst[2 * j + 1] = q_buf[j];
+      }
+      break;
+    }
+    case iq_format_t::CS16:
+      store_scaled(i_buf, q_buf, m, reinterpret_cast<int16_t*>(out), 32767, 0);
+      break;
+    case iq_format_t::CS8:
+      store_scaled(i_buf, q_buf, m, reinterpret_cast<int8_t*>(out), 127, 0);
+      break;
+    case iq_format_t::CU8:
+      store_scaled(i_buf, q_buf, m, out, 127, 128);
+      break;
+  }
+  return m;
+}
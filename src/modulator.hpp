@@ -0,0 +1,65 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "iq.hpp"
+
+// Turns an envelope (0 for level 0, 1 for level 1, anything in between for
+// shaped edges) into IQ samples for the schemes IQConverter cannot do with a
+// per-sample select: SSB-ASK, PR-ASK and any scheme with an IF offset. Each
+// block goes through keying, the Hilbert filter, the NCO and the conversion
+// to the output format in one pass while it is in cache.
+//
+// The SSB Hilbert filter looks ahead by delay() samples, so process() holds
+// back that many samples until finish(); in total every input sample yields
+// one output sample, aligned with the input.
+class Modulator {
+ public:
+  // Hilbert filter half length; the filter has 2 * hilbert_half + 1 taps.
+  static constexpr size_t hilbert_half = 127;
+
+  Modulator(iq_format_t format, Modulation modulation);
+
+  // Whether modulation needs a Modulator rather than plain level mapping.
+  static bool needed(const Modulation& modulation);
+
+  size_t sample_size() const { return unit; }
+  // Samples held back by process() until finish().
+  size_t delay() const { return scheme == modulation_t::SSB ? hilbert_half : 0; }
+
+  // Modulate n envelope samples into out, which must hold n IQ samples.
+  // Returns the number of samples written.
+  size_t process(const float* envelope, size_t n, void* out);
+  // Write the samples still held back (at most delay()) at the end of the
+  // signal.
+  size_t finish(void* out);
+
+ private:
+  size_t emit(const float* baseband, size_t n, uint8_t* out);
+  size_t run_hilbert(float* i_out, float* q_out);
+
+  iq_format_t fmt;
+  size_t unit;
+  modulation_t scheme;
+  float lo;
+  float hi;
+
+  // PR-ASK: current carrier sign and the previous envelope sample.
+  float sign = 1.0f;
+  float prev = 1.0f;
+
+  // SSB: odd Hilbert taps h[1], h[3], ... and the filter's delay line.
+  std::vector<float> taps;
+  std::vector<float> line;
+  bool primed = false;
+
+  // NCO: rotation by k samples for k = 0..nco_group, and the phasor of the
+  // next output sample.
+  static constexpr size_t nco_group = 16;
+  bool nco = false;
+  std::vector<std::complex<double>> rotation;
+  std::complex<double> phasor{1, 0};
+};
@@ -0,0 +1,94 @@
+#include "preview.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+LevelPyramid::LevelPyramid(const RleWave& wave) : runs(wave.runs()), n_samples(wave.size()) {
+  run_start.reserve(runs.size());
+  uint64_t pos = 0;
+  for (auto& run : runs) {
+    run_start.push_back(pos);
+    pos += run.length;
+  }
+
+  std::vector<LevelSpan> base((n_samples + bucket_size - 1) / bucket_size);
+  pos = 0;
+  for (auto& run : runs) {
+    if (run.length == 0) {
+      continue;
+    }
+    LevelSpan level{run.level, run.level};
+    uint64_t end = pos + run.length;
+    for (uint64_t bucket = pos / bucket_size; bucket * bucket_size < end; ++bucket) {
+      base[bucket].merge(level);
+    }
+    pos = end;
+  }
+  levels.push_back(std::move(base));
+
+  while (levels.back().size() > 1) {
+    auto& below = levels.back();
+    std::vector<LevelSpan> above((below.size() + 1) / 2);
+    for (size_t i = 0; i < below.size(); ++i) {
+      above[i / 2].merge(below[i]);
+    }
+    levels.push_back(std::move(above));
+  }
+}
+
+LevelSpan LevelPyramid::exact(uint64_t begin, uint64_t end) const {
+  LevelSpan result;
+  if (begin >= end) {
+    return result;
+  }
+  size_t i = std::upper_bound(run_start.begin(), run_start.end(), begin) - run_start.begin() - 1;
+  for (; i < runs.size() && run_start[i] < end; ++i) {
+    if (runs[i].length) {
+      result.merge({runs[i].level, runs[i].level});
+    }
+  }
+  return result;
+}
+
+LevelSpan LevelPyramid::span(uint64_t begin, uint64_t end) const {
+  end = std::min(end, n_samples);
+  if (begin >= end) {
+    return {};
+  }
+  uint64_t first = (begin + bucket_size - 1) / bucket_size;
+  uint64_t last = end / bucket_size;
+  if (first >= last) {
+    return exact(begin, end);
+  }
+
+  LevelSpan result = exact(begin, first * bucket_size);
+  result.merge(exact(last * bucket_size, end));
+  // Bottom-up range walk: take the unpaired bucket at either end, then move
+  // up a level where the rest pair up.
+  for (size_t k = 0; first < last; ++k) {
+    if (first & 1) {
+      result.merge(levels[k][first++]);
+    }
+    if (last & 1) {
+      result.merge(levels[k][--last]);
+    }
+    first >>= 1;
+    last >>= 1;
+  }
+  return result;
+}
+
+void LevelPyramid::columns(double begin, double end, size_t n_columns, std::vector<LevelSpan>& out) const {
+  out.assign(n_columns, LevelSpan{});
+  double per_column = (end - begin) / n_columns;
+  for (size_t c = 0; c < n_columns; ++c) {
+    double from = begin + c * per_column;
+    if (from < 0) {
+      continue;
+    }
+    // Every column covers at least the sample it starts in.
+    auto first = static_cast<uint64_t>(from);
+    auto last = std::max(first + 1, static_cast<uint64_t>(std::ceil(from + per_column)));
+    out[c] = span(first, last);
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "rle.hpp"
+#include "sink.hpp"
+
+// Lowest and highest level over a range of samples; empty when lo > hi.
+struct LevelSpan {
+  uint8_t lo = 255;
+  uint8_t hi = 0;
+
+  bool empty() const { return lo > hi; }
+  void merge(const LevelSpan& other) {
+    lo = other.lo < lo ? other.lo : lo;
+    hi = other.hi > hi ? other.hi : hi;
+  }
+};
+
+// Min/max decimation pyramid of a level waveform, for drawing it at any
+// zoom. Level 0 holds the span of every bucket_size samples and each level
+// above halves the resolution, so any range is covered by O(log n) stored
+// spans plus at most two partial buckets, which are read from the runs.
+// Rendering a view therefore costs about one lookup chain per pixel column
+// however many samples it spans, and the pyramid takes about
+// 4 / bucket_size bytes per sample.
+class LevelPyramid {
+ public:
+  static constexpr size_t bucket_size = 16;
+
+  explicit LevelPyramid(const RleWave& wave);
+
+  uint64_t size() const { return n_samples; }
+  // Span of samples [begin, end), clamped to the waveform.
+  LevelSpan span(uint64_t begin, uint64_t end) const;
+  // Spans of n_columns equal slices of [begin, end), which may be fractional
+  // so that the view can zoom in past one sample per column.
+  void columns(double begin, double end, size_t n_columns, std::vector<LevelSpan>& out) const;
+
+ private:
+  // Span read from the runs, for ranges shorter than a bucket.
+  LevelSpan exact(uint64_t begin, uint64_t end) const;
+
+  std::vector<Run> runs;
+  // Sample index at which each run starts.
+  std::vector<uint64_t> run_start;
+  std::vector<std::vector<LevelSpan>> levels;
+  uint64_t n_samples = 0;
+};
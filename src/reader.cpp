@@ -2,163 +2,370 @@
 
 #include <cmath>
 #include <iostream>
+#include <mutex>
+#include <tuple>
 
 #include "crc/crc.hpp"
+#include "stats.hpp"
 
-std::vector<int> ebv_encode(const std::vector<int>& bits) {
-  int n_pad = ((bits.size() + 6) / 7 * 7) - bits.size();
-  std::vector<int> padded_bits(n_pad, 0);
-  padded_bits.insert(padded_bits.end(), bits.begin(), bits.end());
-
-  int n_block = padded_bits.size() / 7;
-  std::vector<int> encoded;
-  for (int n = 0; n < n_block; ++n) {
-    int extension_bit = (n < n_block - 1) ? 1 : 0;
-    encoded.push_back(extension_bit);
-    encoded.insert(encoded.end(), padded_bits.begin() + n * 7, padded_bits.begin() + (n + 1) * 7);
+// Throws unless PW and TRcal are whole samples long at the sample rate,
+// with TRcal longer than PW.
+static void check_timing(int samp_rate, int pw_d, double blf, double dr) {
+  int n_pw = static_cast<int>(pw_d * 1e-6 * samp_rate);
+  int n_trcal = static_cast<int>(dr / blf * samp_rate);
+  if (n_pw <= 0 || n_trcal <= n_pw) {
+    throw std::invalid_argument("Sample rate is too low for the requested PIE timing.");
   }
-  return encoded;
 }
 
-PulseIntervalEncoder::PulseIntervalEncoder(int samp_rate, int pw_d) : samp_rate(samp_rate), pw_d(pw_d) {
-  n_data0 = static_cast<int>(2 * pw_d * 1e-6 * samp_rate);
-  n_data1 = static_cast<int>(4 * pw_d * 1e-6 * samp_rate);
-  n_pw = static_cast<int>(pw_d * 1e-6 * samp_rate);
-  n_delim = static_cast<int>(DELIM_DURATION * 1e-6 * samp_rate);
-  n_rtcal = static_cast<int>(6 * pw_d * 1e-6 * samp_rate);
+static PieTemplates build_templates(int samp_rate, int pw_d, double blf, double dr) {
+  check_timing(samp_rate, pw_d, blf, dr);
+  int n_data0 = static_cast<int>(2 * pw_d * 1e-6 * samp_rate);
+  int n_data1 = static_cast<int>(4 * pw_d * 1e-6 * samp_rate);
+  int n_pw = static_cast<int>(pw_d * 1e-6 * samp_rate);
+  int n_delim = static_cast<int>(DELIM_DURATION * 1e-6 * samp_rate);
+  int n_rtcal = static_cast<int>(6 * pw_d * 1e-6 * samp_rate);
+  int n_trcal = static_cast<int>(dr / blf * samp_rate);
+
+  PieTemplates t;
+  t.data0.append(1, n_data0 - n_pw);
+  t.data0.append(0, n_pw);
 
-  data0.resize(n_data0, 1);
-  std::fill(data0.end() - n_pw, data0.end(), 0);
+  t.data1.append(1, n_data1 - n_pw);
+  t.data1.append(0, n_pw);
 
-  data1.resize(n_data1, 1);
-  std::fill(data1.end() - n_pw, data1.end(), 0);
+  t.frame_sync.append(0, n_delim);
+  t.frame_sync.append(t.data0);
+  t.frame_sync.append(1, n_rtcal - n_pw);
+  t.frame_sync.append(0, n_pw);
+
+  t.preamble = t.frame_sync;
+  t.preamble.append(1, n_trcal - n_pw);
+  t.preamble.append(0, n_pw);
+  return t;
 }
 
-std::vector<int> PulseIntervalEncoder::preamble(double blf, int dr) {
-  int n_trcal = static_cast<int>(dr / blf * samp_rate);
-  std::vector<int> delim(n_delim, 0);
-  std::vector<int> rt_cal(n_rtcal, 1);
-  std::fill(rt_cal.end() - n_pw, rt_cal.end(), 0);
+PieTemplateCache& PieTemplateCache::shared() {
+  static PieTemplateCache cache;
+  return cache;
+}
 
-  std::vector<int> tr_cal(n_trcal, 1);
-  std::fill(tr_cal.end() - n_pw, tr_cal.end(), 0);
+std::shared_ptr<const PieTemplates> PieTemplateCache::get(int samp_rate, int pw_d, double blf, double dr) {
+  auto key = std::make_tuple(samp_rate, pw_d, blf, dr);
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+      it->second.last_used.store(clock, std::memory_order_relaxed);
+      return it->second.templates;
+    }
+  }
 
-  std::vector<int> result = delim;
-  result.insert(result.end(), data0.begin(), data0.end());
-  result.insert(result.end(), rt_cal.begin(), rt_cal.end());
-  result.insert(result.end(), tr_cal.begin(), tr_cal.end());
-  return result;
+  // Build outside the lock; if another thread wins the race its entry is kept.
+  auto templates = std::make_shared<const PieTemplates>(build_templates(samp_rate, pw_d, blf, dr));
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  auto [it, inserted] = entries.try_emplace(key);
+  if (inserted) {
+    it->second.templates = std::move(templates);
+    if (entries.size() > capacity) {
+      auto oldest = entries.end();
+      for (auto e = entries.begin(); e != entries.end(); ++e) {
+        if (e != it && (oldest == entries.end() || e->second.last_used < oldest->second.last_used)) {
+          oldest = e;
+        }
+      }
+      entries.erase(oldest);
+    }
+  }
+  it->second.last_used.store(++clock, std::memory_order_relaxed);
+  return it->second.templates;
+}
+
+void PieTemplateCache::clear() {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  entries.clear();
 }
 
-std::vector<int> PulseIntervalEncoder::frame_sync() {
-  std::vector<int> delim(n_delim, 0);
-  std::vector<int> rt_cal(n_rtcal, 1);
-  std::fill(rt_cal.end() - n_pw, rt_cal.end(), 0);
+size_t PieTemplateCache::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return entries.size();
+}
 
-  std::vector<int> result = delim;
-  result.insert(result.end(), data0.begin(), data0.end());
-  result.insert(result.end(), rt_cal.begin(), rt_cal.end());
-  return result;
+PulseIntervalEncoder::PulseIntervalEncoder(int samp_rate, int pw_d, timing_t timing)
+    : samp_rate(samp_rate),
+      pw_d(pw_d),
+      timing_mode(timing),
+      templates(PieTemplateCache::shared().get(samp_rate, pw_d)),
+      fx_pw(fixed_samples(pw_d * 1e-6, samp_rate)),
+      fx_data0(fixed_samples(2 * pw_d * 1e-6, samp_rate)),
+      fx_data1(fixed_samples(4 * pw_d * 1e-6, samp_rate)),
+      fx_delim(fixed_samples(DELIM_DURATION * 1e-6, samp_rate)),
+      fx_rtcal(fixed_samples(6 * pw_d * 1e-6, samp_rate)) {}
+
+uint64_t PulseIntervalEncoder::fixed_samples(double seconds, int samp_rate) {
+  return static_cast<uint64_t>(std::llround(std::ldexp(seconds * samp_rate, 32)));
+}
+
+// Advance the ideal time by duration and write the samples up to the
+// nearest sample boundary. Durations telescope, so the rounding error never
+// exceeds half a sample however many segments are emitted.
+void PulseIntervalEncoder::emit(WaveSink& sink, uint8_t level, uint64_t duration, pie_phase_t& phase) const {
+  uint64_t total = phase + duration;
+  phase = static_cast<pie_phase_t>(total);
+  EPCPHY_COUNT(stage_t::PIE, total >> 32, 0);
+  sink.fill(level, total >> 32);
+}
+
+// Set bits in [begin, end) of data, for the sample count of an encode().
+[[maybe_unused]] static size_t ones_in(const BitBuffer& data, size_t begin, size_t end) {
+  size_t n = 0;
+  for (size_t i = begin; i < end; ++i) {
+    n += data[i];
+  }
+  return n;
+}
+
+void PulseIntervalEncoder::preamble(WaveSink& sink, double blf, double dr) const {
+  pie_phase_t phase = pie_phase_start;
+  preamble(sink, blf, dr, phase);
+}
+
+void PulseIntervalEncoder::frame_sync(WaveSink& sink) const {
+  pie_phase_t phase = pie_phase_start;
+  frame_sync(sink, phase);
 }
 
-std::vector<int> PulseIntervalEncoder::encode(const std::vector<int>& data) {
-  std::vector<int> sig;
-  for (int bit : data) {
-    if (bit == 0) {
-      sig.insert(sig.end(), data0.begin(), data0.end());
+void PulseIntervalEncoder::encode(WaveSink& sink, const BitBuffer& data) const {
+  encode(sink, data, 0, data.size());
+}
+
+void PulseIntervalEncoder::encode(WaveSink& sink, const BitBuffer& data, size_t begin, size_t end) const {
+  pie_phase_t phase = pie_phase_start;
+  encode(sink, data, begin, end, phase);
+}
+
+void PulseIntervalEncoder::preamble(WaveSink& sink, double blf, double dr, pie_phase_t& phase) const {
+  EPCPHY_STAGE(stage_t::PIE);
+  if (timing_mode == timing_t::TRUNCATE) {
+    // Held for the call: another configuration may evict the cache entry.
+    auto templates = PieTemplateCache::shared().get(samp_rate, pw_d, blf, dr);
+    auto& wave = templates->preamble;
+    EPCPHY_COUNT(stage_t::PIE, wave.size(), 0);
+    wave.expand_to(sink);
+    return;
+  }
+  // Same limits as the TRUNCATE templates, without building them.
+  check_timing(samp_rate, pw_d, blf, dr);
+  frame_sync(sink, phase);
+  emit(sink, 1, fixed_samples(dr / blf, samp_rate) - fx_pw, phase);
+  emit(sink, 0, fx_pw, phase);
+}
+
+void PulseIntervalEncoder::frame_sync(WaveSink& sink, pie_phase_t& phase) const {
+  EPCPHY_STAGE(stage_t::PIE);
+  if (timing_mode == timing_t::TRUNCATE) {
+    EPCPHY_COUNT(stage_t::PIE, templates->frame_sync.size(), 0);
+    templates->frame_sync.expand_to(sink);
+    return;
+  }
+  emit(sink, 0, fx_delim, phase);
+  emit(sink, 1, fx_data0 - fx_pw, phase);
+  emit(sink, 0, fx_pw, phase);
+  emit(sink, 1, fx_rtcal - fx_pw, phase);
+  emit(sink, 0, fx_pw, phase);
+}
+
+void PulseIntervalEncoder::encode(WaveSink& sink, const BitBuffer& data, size_t begin, size_t end,
+                                  pie_phase_t& phase) const {
+  EPCPHY_STAGE(stage_t::PIE);
+  if (timing_mode == timing_t::EXACT) {
+    for (size_t i = begin; i < end; ++i) {
+      emit(sink, 1, (data[i] ? fx_data1 : fx_data0) - fx_pw, phase);
+      emit(sink, 0, fx_pw, phase);
+    }
+    return;
+  }
+  auto& data0 = templates->data0.runs();
+  auto& data1 = templates->data1.runs();
+  for (size_t i = begin; i < end; ++i) {
+    if (data[i] == 0) {
+      sink.write_runs(data0.data(), data0.size());
     } else {
-      sig.insert(sig.end(), data1.begin(), data1.end());
+      sink.write_runs(data1.data(), data1.size());
     }
   }
-  return sig;
+  EPCPHY_COUNT(stage_t::PIE,
+               (end - begin) * templates->data0.size() +
+                   ones_in(data, begin, end) * (templates->data1.size() - templates->data0.size()),
+               0);
+}
+
+size_t PulseIntervalEncoder::encoded_length(const BitBuffer& data) const {
+  size_t n_ones = data.count();
+  if (timing_mode == timing_t::EXACT) {
+    return (pie_phase_start + n_ones * fx_data1 + (data.size() - n_ones) * fx_data0) >> 32;
+  }
+  return n_ones * templates->data1.size() + (data.size() - n_ones) * templates->data0.size();
+}
+
+template <typename T>
+std::vector<T> PulseIntervalEncoder::preamble(double blf, double dr) const {
+  std::vector<T> result;
+  VectorSink<T> sink(result);
+  preamble(sink, blf, dr);
+  return result;
+}
+
+template <typename T>
+std::vector<T> PulseIntervalEncoder::frame_sync() const {
+  std::vector<T> result;
+  VectorSink<T> sink(result);
+  frame_sync(sink);
+  return result;
+}
+
+template <typename T>
+std::vector<T> PulseIntervalEncoder::encode(const BitBuffer& data) const {
+  std::vector<T> result;
+  result.reserve(encoded_length(data));
+  VectorSink<T> sink(result);
+  encode(sink, data);
+  EPCPHY_BUFFER(result.size() * sizeof(T));
+  return result;
+}
+
+static thread_local CommandArena* current_arena = nullptr;
+
+CommandArena::CommandArena(size_t bytes)
+    : buffer(bytes), resource(buffer.data(), buffer.size()), previous(current_arena) {
+  current_arena = this;
+}
+
+CommandArena::~CommandArena() { current_arena = previous; }
+
+CommandArena* CommandArena::current() { return current_arena; }
+
+std::pmr::memory_resource* CommandArena::begin() {
+  ++depth;
+  return &resource;
+}
+
+void CommandArena::end() {
+  if (--depth == 0) {
+    resource.release();
+  }
 }
 
-RFIDReaderCommand::RFIDReaderCommand(PulseIntervalEncoder* pie) : pie(pie) {}
+// Memory for the bits of one command: the thread's arena, rewound when the
+// command is done, or the default heap. Declared before the bits so that it
+// outlives them.
+struct CommandScratch {
+  CommandArena* arena = CommandArena::current();
+  std::pmr::memory_resource* memory = arena ? arena->begin() : std::pmr::get_default_resource();
+
+  CommandScratch() = default;
+  CommandScratch(const CommandScratch&) = delete;
+  CommandScratch& operator=(const CommandScratch&) = delete;
+  ~CommandScratch() {
+    if (arena) {
+      arena->end();
+    }
+  }
+};
+
+RFIDReaderCommand::RFIDReaderCommand(std::shared_ptr<const PulseIntervalEncoder> pie, double blf)
+    : pie(std::move(pie)), blf(blf) {
+  if (!this->pie) {
+    throw std::invalid_argument("RFIDReaderCommand needs an encoder.");
+  }
+  if (blf <= 0) {
+    throw std::invalid_argument("BLF must be positive.");
+  }
+}
 
-std::vector<int> RFIDReaderCommand::select(int pointer, uint8_t length, const std::vector<int>& mask, bool trunc,
-                                           target_t target, uint8_t action, membank_t mem_bank) {
-  std::vector<int> bits = {1, 0, 1, 0};
+BitBuffer RFIDReaderCommand::select_bits(int pointer, uint8_t length, const BitBuffer& mask, bool trunc,
+                                         target_t target, uint8_t action, membank_t mem_bank,
+                                         std::pmr::memory_resource* memory) {
+  EPCPHY_STAGE(stage_t::BITS);
+  // Fixed fields, pointer of up to five EBV blocks, mask, truncate, CRC-16.
+  BitBuffer bits(memory);
+  bits.reserve(4 + 3 + 3 + 2 + 40 + 8 + mask.size() + 1 + 16);
+  bits.append(0b1010, 4);
 
   switch (target) {
     case target_t::INV_S0:
-      bits.insert(bits.end(), {0, 0, 0});
+      bits.append(0b000, 3);
       break;
     case target_t::INV_S1:
-      bits.insert(bits.end(), {0, 0, 1});
+      bits.append(0b001, 3);
       break;
     case target_t::INV_S2:
-      bits.insert(bits.end(), {0, 1, 0});
+      bits.append(0b010, 3);
       break;
     case target_t::INV_S3:
-      bits.insert(bits.end(), {0, 1, 1});
+      bits.append(0b011, 3);
       break;
     case target_t::SL:
-      bits.insert(bits.end(), {1, 0, 0});
+      bits.append(0b100, 3);
       break;
   }
 
-  bits.insert(bits.end(), {action & 4, action & 2, action & 1});
+  bits.append(action, 3);
 
   switch (mem_bank) {
     case membank_t::FILE_TYPE:
-      bits.insert(bits.end(), {0, 0});
+      bits.append(0b00, 2);
       break;
     case membank_t::EPC:
-      bits.insert(bits.end(), {0, 1});
+      bits.append(0b01, 2);
       break;
     case membank_t::TID:
-      bits.insert(bits.end(), {1, 0});
+      bits.append(0b10, 2);
       break;
     case membank_t::FILE_0:
-      bits.insert(bits.end(), {1, 1});
+      bits.append(0b11, 2);
       break;
   }
 
   // Pointer bits (EBV encoded)
-  std::vector<int> pointer_bits;
-  for (int i = 0; i < 32; ++i) {
-    pointer_bits.push_back(pointer >> (31 - i) & 1);
-  }
-  bits.insert(bits.end(), ebv_encode(pointer_bits).begin(), ebv_encode(pointer_bits).end());
+  ebv_append(bits, pointer);
 
-  for (int i = 0; i < 8; ++i) {
-    bits.push_back(length >> (7 - i) & 1);
-  }
+  bits.append(length, 8);
 
   if (mask.size() != length) {
     throw std::invalid_argument("Mask length must match the specified length.");
   }
-  bits.insert(bits.end(), mask.begin(), mask.end());
+  bits.append(mask);
 
   bits.push_back(trunc ? 1 : 0);
 
-  std::vector<int> crc_bits = crc16(bits);
-  bits.insert(bits.end(), crc_bits.begin(), crc_bits.end());
+  bits.append(crc16(bits), 16);
 
-  auto sync_wave = pie->frame_sync();
-  auto wave = pie->encode(bits);
-  wave.insert(wave.begin(), sync_wave.begin(), sync_wave.end());
-  return wave;
+  EPCPHY_COUNT(stage_t::BITS, 0, bits.byte_size());
+  return bits;
 }
 
-std::vector<int> RFIDReaderCommand::query(dr_t dr, miller_t m, bool trext, sel_t sel, session_t session,
-                                          inventory_t target, int q) {
-  std::vector<int> bits = {1, 0, 0, 0};
+BitBuffer RFIDReaderCommand::query_bits(dr_t dr, miller_t m, bool trext, sel_t sel, session_t session,
+                                        inventory_t target, int q, std::pmr::memory_resource* memory) {
+  EPCPHY_STAGE(stage_t::BITS);
+  BitBuffer bits(memory);
+  bits.reserve(22);
+  bits.append(0b1000, 4);
 
   bits.push_back((dr == dr_t::DR_64_3) ? 1 : 0);
 
   switch (m) {
     case miller_t::M1:
-      bits.insert(bits.end(), {0, 0});
+      bits.append(0b00, 2);
       break;
     case miller_t::M2:
-      bits.insert(bits.end(), {0, 1});
+      bits.append(0b01, 2);
       break;
     case miller_t::M4:
-      bits.insert(bits.end(), {1, 0});
+      bits.append(0b10, 2);
       break;
     case miller_t::M8:
-      bits.insert(bits.end(), {1, 1});
+      bits.append(0b11, 2);
       break;
   }
 
@@ -166,115 +373,220 @@ std::vector<int> RFIDReaderCommand::query(dr_t dr, miller_t m, bool trext, sel_t
 
   switch (sel) {
     case sel_t::ALL:
-      bits.insert(bits.end(), {0, 0});
+      bits.append(0b00, 2);
       break;
     case sel_t::NOT_SL:
-      bits.insert(bits.end(), {1, 0});
+      bits.append(0b10, 2);
       break;
     case sel_t::SL:
-      bits.insert(bits.end(), {1, 1});
+      bits.append(0b11, 2);
       break;
   }
 
   switch (session) {
     case session_t::S0:
-      bits.insert(bits.end(), {0, 0});
+      bits.append(0b00, 2);
       break;
     case session_t::S1:
-      bits.insert(bits.end(), {0, 1});
+      bits.append(0b01, 2);
       break;
     case session_t::S2:
-      bits.insert(bits.end(), {1, 0});
+      bits.append(0b10, 2);
       break;
     case session_t::S3:
-      bits.insert(bits.end(), {1, 1});
+      bits.append(0b11, 2);
       break;
   }
 
   bits.push_back((target == inventory_t::B) ? 1 : 0);
 
   // Q bits
-  for (int i = 0; i < 4; ++i) {
-    bits.push_back(q >> (3 - i) & 1);
-  }
+  bits.append(q, 4);
 
   // CRC5
-  std::vector<int> crc_bits = crc5(bits);
-  bits.insert(bits.end(), crc_bits.begin(), crc_bits.end());
+  bits.append(crc5(bits), 5);
 
-  auto preamble_wave = pie->preamble(40000, (dr == dr_t::DR_8) ? 8 : 64 / 3);
-  auto wave = pie->encode(bits);
-  wave.insert(wave.begin(), preamble_wave.begin(), preamble_wave.end());
-  return wave;
+  EPCPHY_COUNT(stage_t::BITS, 0, bits.byte_size());
+  return bits;
 }
 
-std::vector<int> RFIDReaderCommand::query_rep(session_t session) {
-  std::vector<int> bits = {0, 0};
+BitBuffer RFIDReaderCommand::query_rep_bits(session_t session, std::pmr::memory_resource* memory) {
+  EPCPHY_STAGE(stage_t::BITS);
+  BitBuffer bits(memory);
+  bits.reserve(4);
+  bits.append(0b00, 2);
 
   switch (session) {
     case session_t::S0:
-      bits.insert(bits.end(), {0, 0});
+      bits.append(0b00, 2);
       break;
     case session_t::S1:
-      bits.insert(bits.end(), {0, 1});
+      bits.append(0b01, 2);
       break;
     case session_t::S2:
-      bits.insert(bits.end(), {1, 0});
+      bits.append(0b10, 2);
       break;
     case session_t::S3:
-      bits.insert(bits.end(), {1, 1});
+      bits.append(0b11, 2);
       break;
   }
 
-  auto sync_wave = pie->frame_sync();
-  auto wave = pie->encode(bits);
-  wave.insert(wave.begin(), sync_wave.begin(), sync_wave.end());
-  return wave;
+  EPCPHY_COUNT(stage_t::BITS, 0, bits.byte_size());
+  return bits;
 }
 
-std::vector<int> RFIDReaderCommand::query_adjust(session_t session, updn_t updn) {
-  std::vector<int> bits = {1, 0, 0, 1};
+BitBuffer RFIDReaderCommand::query_adjust_bits(session_t session, updn_t updn, std::pmr::memory_resource* memory) {
+  EPCPHY_STAGE(stage_t::BITS);
+  BitBuffer bits(memory);
+  bits.reserve(9);
+  bits.append(0b1001, 4);
 
   switch (session) {
     case session_t::S0:
-      bits.insert(bits.end(), {0, 0});
+      bits.append(0b00, 2);
       break;
     case session_t::S1:
-      bits.insert(bits.end(), {0, 1});
+      bits.append(0b01, 2);
       break;
     case session_t::S2:
-      bits.insert(bits.end(), {1, 0});
+      bits.append(0b10, 2);
       break;
     case session_t::S3:
-      bits.insert(bits.end(), {1, 1});
+      bits.append(0b11, 2);
       break;
   }
 
   switch (updn) {
     case updn_t::UNCHANGED:
-      bits.insert(bits.end(), {0, 0, 0});
+      bits.append(0b000, 3);
       break;
     case updn_t::INCREACE:
-      bits.insert(bits.end(), {1, 1, 0});
+      bits.append(0b110, 3);
       break;
     case updn_t::DECREASE:
-      bits.insert(bits.end(), {0, 1, 1});
+      bits.append(0b011, 3);
       break;
   }
 
-  auto sync_wave = pie->frame_sync();
-  auto wave = pie->encode(bits);
-  wave.insert(wave.begin(), sync_wave.begin(), sync_wave.end());
+  EPCPHY_COUNT(stage_t::BITS, 0, bits.byte_size());
+  return bits;
+}
+
+BitBuffer RFIDReaderCommand::ack_bits(const BitBuffer& rn16, std::pmr::memory_resource* memory) {
+  EPCPHY_STAGE(stage_t::BITS);
+  BitBuffer bits(memory);
+  bits.reserve(2 + rn16.size());
+  bits.append(0b01, 2);
+
+  bits.append(rn16);
+
+  EPCPHY_COUNT(stage_t::BITS, 0, bits.byte_size());
+  return bits;
+}
+
+void RFIDReaderCommand::select(WaveSink& sink, int pointer, uint8_t length, const BitBuffer& mask, bool trunc,
+                               target_t target, uint8_t action, membank_t mem_bank) const {
+  CommandScratch scratch;
+  auto bits = select_bits(pointer, length, mask, trunc, target, action, mem_bank, scratch.memory);
+  pie_phase_t phase = pie_phase_start;
+  pie->frame_sync(sink, phase);
+  pie->encode(sink, bits, 0, bits.size(), phase);
+}
+
+void RFIDReaderCommand::query(WaveSink& sink, dr_t dr, miller_t m, bool trext, sel_t sel, session_t session,
+                              inventory_t target, int q) const {
+  CommandScratch scratch;
+  auto bits = query_bits(dr, m, trext, sel, session, target, q, scratch.memory);
+  pie_phase_t phase = pie_phase_start;
+  pie->preamble(sink, blf, (dr == dr_t::DR_8) ? 8 : 64.0 / 3, phase);
+  pie->encode(sink, bits, 0, bits.size(), phase);
+}
+
+void RFIDReaderCommand::query_rep(WaveSink& sink, session_t session) const {
+  CommandScratch scratch;
+  auto bits = query_rep_bits(session, scratch.memory);
+  pie_phase_t phase = pie_phase_start;
+  pie->frame_sync(sink, phase);
+  pie->encode(sink, bits, 0, bits.size(), phase);
+}
+
+void RFIDReaderCommand::query_adjust(WaveSink& sink, session_t session, updn_t updn) const {
+  CommandScratch scratch;
+  auto bits = query_adjust_bits(session, updn, scratch.memory);
+  pie_phase_t phase = pie_phase_start;
+  pie->frame_sync(sink, phase);
+  pie->encode(sink, bits, 0, bits.size(), phase);
+}
+
+void RFIDReaderCommand::ack(WaveSink& sink, const BitBuffer& rn16) const {
+  CommandScratch scratch;
+  auto bits = ack_bits(rn16, scratch.memory);
+  pie_phase_t phase = pie_phase_start;
+  pie->frame_sync(sink, phase);
+  pie->encode(sink, bits, 0, bits.size(), phase);
+}
+
+template <typename T>
+std::vector<T> RFIDReaderCommand::select(int pointer, uint8_t length, const BitBuffer& mask, bool trunc,
+                                         target_t target, uint8_t action, membank_t mem_bank) const {
+  std::vector<T> wave;
+  VectorSink<T> sink(wave);
+  select(sink, pointer, length, mask, trunc, target, action, mem_bank);
+  EPCPHY_BUFFER(wave.size() * sizeof(T));
   return wave;
 }
 
-std::vector<int> RFIDReaderCommand::ack(const std::vector<int>& rn16) {
-  std::vector<int> bits = {0, 1};
+template <typename T>
+std::vector<T> RFIDReaderCommand::query(dr_t dr, miller_t m, bool trext, sel_t sel, session_t session,
+                                        inventory_t target, int q) const {
+  std::vector<T> wave;
+  VectorSink<T> sink(wave);
+  query(sink, dr, m, trext, sel, session, target, q);
+  EPCPHY_BUFFER(wave.size() * sizeof(T));
+  return wave;
+}
 
-  bits.insert(bits.end(), rn16.begin(), rn16.end());
+template <typename T>
+std::vector<T> RFIDReaderCommand::query_rep(session_t session) const {
+  std::vector<T> wave;
+  VectorSink<T> sink(wave);
+  query_rep(sink, session);
+  EPCPHY_BUFFER(wave.size() * sizeof(T));
+  return wave;
+}
 
-  auto sync_wave = pie->frame_sync();
-  auto wave = pie->encode(bits);
-  wave.insert(wave.begin(), sync_wave.begin(), sync_wave.end());
+template <typename T>
+std::vector<T> RFIDReaderCommand::query_adjust(session_t session, updn_t updn) const {
+  std::vector<T> wave;
+  VectorSink<T> sink(wave);
+  query_adjust(sink, session, updn);
+  EPCPHY_BUFFER(wave.size() * sizeof(T));
   return wave;
 }
+
+template <typename T>
+std::vector<T> RFIDReaderCommand::ack(const BitBuffer& rn16) const {
+  std::vector<T> wave;
+  VectorSink<T> sink(wave);
+  ack(sink, rn16);
+  EPCPHY_BUFFER(wave.size() * sizeof(T));
+  return wave;
+}
+
+#define INSTANTIATE_SAMPLE_TYPE(T)                                                                                    \
+  template std::vector<T> PulseIntervalEncoder::preamble<T>(double, double) const;                                   \
+  template std::vector<T> PulseIntervalEncoder::frame_sync<T>() const;                                               \
+  template std::vector<T> PulseIntervalEncoder::encode<T>(const BitBuffer&) const;                                   \
+  template std::vector<T> RFIDReaderCommand::select<T>(int, uint8_t, const BitBuffer&, bool, target_t, uint8_t,      \
+                                                       membank_t) const;                                             \
+  template std::vector<T> RFIDReaderCommand::query<T>(dr_t, miller_t, bool, sel_t, session_t, inventory_t, int)      \
+      const;                                                                                                         \
+  template std::vector<T> RFIDReaderCommand::query_rep<T>(session_t) const;                                          \
+  template std::vector<T> RFIDReaderCommand::query_adjust<T>(session_t, updn_t) const;                               \
+  template std::vector<T> RFIDReaderCommand::ack<T>(const BitBuffer&) const;
+
+INSTANTIATE_SAMPLE_TYPE(uint8_t)
+INSTANTIATE_SAMPLE_TYPE(int16_t)
+INSTANTIATE_SAMPLE_TYPE(float)
+
+#undef INSTANTIATE_SAMPLE_TYPE
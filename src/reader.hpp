@@ -1,10 +1,21 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <shared_mutex>
 #include <stdexcept>
 #include <string>
+#include <tuple>
 #include <vector>
 
+#include "bits.hpp"
+#include "rle.hpp"
+#include "sink.hpp"
+
 const int DELIM_DURATION = 12;
 
 enum class target_t { INV_S0, INV_S1, INV_S2, INV_S3, SL };
@@ -15,40 +26,190 @@ enum class dr_t { DR_8, DR_64_3 };
 enum class sel_t { ALL, SL, NOT_SL };
 enum class updn_t { UNCHANGED, INCREACE, DECREASE };
 enum class miller_t { M1, M2, M4, M8 };
+enum class command_t { SELECT, QUERY, QUERY_REP, QUERY_ADJUST, ACK };
+
+// How symbol durations map to samples. TRUNCATE rounds every symbol down to
+// whole samples, so the error grows with the frame length unless the sample
+// rate is a multiple of 1 / PW. EXACT tracks the ideal edge time with a
+// fixed-point phase accumulator and puts every edge on the nearest sample,
+// so the error stays below half a sample over any frame length.
+enum class timing_t { TRUNCATE, EXACT };
+
+// Position of the ideal edge time relative to the samples written so far in
+// EXACT timing, as a 0.32 fixed-point fraction of a sample (offset by half a
+// sample, so that truncation rounds to nearest). Threaded through the calls
+// that make up one frame.
+using pie_phase_t = uint32_t;
+constexpr pie_phase_t pie_phase_start = 1u << 31;
+
+// Every PIE sample is either 0 or 1, so waveforms default to one byte per
+// sample. The encoders are also instantiated for int16_t and float.
+using sample_t = uint8_t;
+
+// Run templates for one PIE link configuration. The preamble is the
+// frame-sync followed by TRcal.
+struct PieTemplates {
+  RleWave data0;
+  RleWave data1;
+  RleWave frame_sync;
+  RleWave preamble;
+};
+
+// Process-wide, thread-safe memo of PieTemplates keyed by
+// (samp_rate, pw_d, BLF, DR), so encoders built for the same configuration
+// share their templates instead of rebuilding them. At most capacity
+// configurations are kept; inserting another drops the least recently used
+// one (callers holding its templates keep them alive).
+class PieTemplateCache {
+ public:
+  static constexpr size_t capacity = 64;
 
-std::vector<int> ebv_encode(const std::vector<int>& bits);
+  static PieTemplateCache& shared();
 
+  std::shared_ptr<const PieTemplates> get(int samp_rate, int pw_d, double blf = 40000, double dr = 8);
+  void clear();
+  size_t size() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<const PieTemplates> templates;
+    // Value of clock at the last lookup; hits only hold the shared lock.
+    std::atomic<uint64_t> last_used{0};
+  };
+
+  mutable std::shared_mutex mutex;
+  std::map<std::tuple<int, int, double, double>, Entry> entries;
+  // Advanced on every insertion, under the exclusive lock.
+  uint64_t clock = 0;
+};
+
+// Immutable once constructed, so one encoder can be shared by any number of
+// threads.
 class PulseIntervalEncoder {
  public:
-  PulseIntervalEncoder(int samp_rate, int pw_d = 12);
-  std::vector<int> preamble(double blf = 40000, int dr = 8);
-  std::vector<int> frame_sync();
-  std::vector<int> encode(const std::vector<int>& data);
+  PulseIntervalEncoder(int samp_rate, int pw_d = 12, timing_t timing = timing_t::TRUNCATE);
+
+  void preamble(WaveSink& sink, double blf = 40000, double dr = 8) const;
+  void frame_sync(WaveSink& sink) const;
+  // Emits two runs per bit; pass an RleSink to keep the result run-length encoded.
+  void encode(WaveSink& sink, const BitBuffer& data) const;
+  // Encode only bits [begin, end) of data.
+  void encode(WaveSink& sink, const BitBuffer& data, size_t begin, size_t end) const;
+  // Number of samples encode() produces for data.
+  size_t encoded_length(const BitBuffer& data) const;
+
+  // Variants that continue from and update phase, for emitting one frame in
+  // several calls. The phase is ignored in TRUNCATE timing.
+  void preamble(WaveSink& sink, double blf, double dr, pie_phase_t& phase) const;
+  void frame_sync(WaveSink& sink, pie_phase_t& phase) const;
+  void encode(WaveSink& sink, const BitBuffer& data, size_t begin, size_t end, pie_phase_t& phase) const;
+
+  int sample_rate() const { return samp_rate; }
+  timing_t timing() const { return timing_mode; }
+  // Nominal RTcal in seconds.
+  double rtcal() const { return 6 * pw_d * 1e-6; }
+
+  template <typename T = sample_t>
+  std::vector<T> preamble(double blf = 40000, double dr = 8) const;
+  template <typename T = sample_t>
+  std::vector<T> frame_sync() const;
+  template <typename T = sample_t>
+  std::vector<T> encode(const BitBuffer& data) const;
 
  private:
+  // Durations in samples, 32.32 fixed point.
+  static uint64_t fixed_samples(double seconds, int samp_rate);
+  void emit(WaveSink& sink, uint8_t level, uint64_t duration, pie_phase_t& phase) const;
+
   int samp_rate;
   int pw_d;
-  int n_data0;
-  int n_data1;
-  int n_pw;
-  int n_delim;
-  int n_rtcal;
-  std::vector<int> data0;
-  std::vector<int> data1;
+  timing_t timing_mode;
+  std::shared_ptr<const PieTemplates> templates;
+  uint64_t fx_pw;
+  uint64_t fx_data0;
+  uint64_t fx_data1;
+  uint64_t fx_delim;
+  uint64_t fx_rtcal;
+};
+
+// Scratch memory for the frame bits that the sink-based RFIDReaderCommand
+// methods build and drop. An arena is installed for its thread while it is
+// alive, and each command rewinds it when done, so steady-state encoding
+// makes no heap allocations once the buffer covers the largest frame
+// (bytes). Threads without an arena use the default heap.
+class CommandArena {
+ public:
+  explicit CommandArena(size_t bytes = 1024);
+  ~CommandArena();
+  CommandArena(const CommandArena&) = delete;
+  CommandArena& operator=(const CommandArena&) = delete;
+
+  // Innermost arena alive on the calling thread, or null.
+  static CommandArena* current();
+
+  // Memory for one command. Nested commands share it; the outermost end()
+  // rewinds the arena.
+  std::pmr::memory_resource* begin();
+  void end();
+
+ private:
+  std::vector<std::byte> buffer;
+  std::pmr::monotonic_buffer_resource resource;
+  CommandArena* previous;
+  int depth = 0;
 };
 
+// Stateless apart from its configuration; all methods are const and safe to
+// call concurrently on a shared instance.
 class RFIDReaderCommand {
  public:
-  RFIDReaderCommand(PulseIntervalEncoder* pie);
-  std::vector<int> select(int pointer, uint8_t length, const std::vector<int>& mask, bool trunc = false,
-                          target_t target = target_t::SL, uint8_t action = 0,
-                          membank_t mem_bank = membank_t::FILE_TYPE);
-  std::vector<int> query(dr_t dr = dr_t::DR_8, miller_t m = miller_t::M1, bool trext = false, sel_t sel = sel_t::ALL,
-                         session_t session = session_t::S0, inventory_t target = inventory_t::A, int q = 0);
-  std::vector<int> query_rep(session_t session = session_t::S0);
-  std::vector<int> query_adjust(session_t session = session_t::S0, updn_t updn = updn_t::UNCHANGED);
-  std::vector<int> ack(const std::vector<int>& rn16);
+  RFIDReaderCommand(std::shared_ptr<const PulseIntervalEncoder> pie, double blf = 40000);
+
+  // Frame bits of each command, without preamble or frame-sync, stored in
+  // memory.
+  static BitBuffer select_bits(int pointer, uint8_t length, const BitBuffer& mask, bool trunc = false,
+                               target_t target = target_t::SL, uint8_t action = 0,
+                               membank_t mem_bank = membank_t::FILE_TYPE,
+                               std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+  static BitBuffer query_bits(dr_t dr = dr_t::DR_8, miller_t m = miller_t::M1, bool trext = false,
+                              sel_t sel = sel_t::ALL, session_t session = session_t::S0,
+                              inventory_t target = inventory_t::A, int q = 0,
+                              std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+  static BitBuffer query_rep_bits(session_t session = session_t::S0,
+                                  std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+  static BitBuffer query_adjust_bits(session_t session = session_t::S0, updn_t updn = updn_t::UNCHANGED,
+                                     std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+  static BitBuffer ack_bits(const BitBuffer& rn16,
+                            std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+  // Append the complete waveform of each command to sink.
+  void select(WaveSink& sink, int pointer, uint8_t length, const BitBuffer& mask, bool trunc = false,
+              target_t target = target_t::SL, uint8_t action = 0, membank_t mem_bank = membank_t::FILE_TYPE) const;
+  void query(WaveSink& sink, dr_t dr = dr_t::DR_8, miller_t m = miller_t::M1, bool trext = false,
+             sel_t sel = sel_t::ALL, session_t session = session_t::S0, inventory_t target = inventory_t::A,
+             int q = 0) const;
+  void query_rep(WaveSink& sink, session_t session = session_t::S0) const;
+  void query_adjust(WaveSink& sink, session_t session = session_t::S0, updn_t updn = updn_t::UNCHANGED) const;
+  void ack(WaveSink& sink, const BitBuffer& rn16) const;
+
+  const PulseIntervalEncoder& encoder() const { return *pie; }
+  double link_frequency() const { return blf; }
+
+  template <typename T = sample_t>
+  std::vector<T> select(int pointer, uint8_t length, const BitBuffer& mask, bool trunc = false,
+                        target_t target = target_t::SL, uint8_t action = 0,
+                        membank_t mem_bank = membank_t::FILE_TYPE) const;
+  template <typename T = sample_t>
+  std::vector<T> query(dr_t dr = dr_t::DR_8, miller_t m = miller_t::M1, bool trext = false, sel_t sel = sel_t::ALL,
+                       session_t session = session_t::S0, inventory_t target = inventory_t::A, int q = 0) const;
+  template <typename T = sample_t>
+  std::vector<T> query_rep(session_t session = session_t::S0) const;
+  template <typename T = sample_t>
+  std::vector<T> query_adjust(session_t session = session_t::S0, updn_t updn = updn_t::UNCHANGED) const;
+  template <typename T = sample_t>
+  std::vector<T> ack(const BitBuffer& rn16) const;
 
  private:
-  PulseIntervalEncoder* pie;
+  std::shared_ptr<const PulseIntervalEncoder> pie;
+  double blf;
 };
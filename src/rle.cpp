@@ -0,0 +1,69 @@
+#include "rle.hpp"
+
+#include <algorithm>
+#include <limits>
+
+void RleWave::append(uint8_t level, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  n_samples += n;
+  if (!run_list.empty() && run_list.back().level == level) {
+    auto& last = run_list.back();
+    size_t room = std::numeric_limits<uint32_t>::max() - last.length;
+    size_t take = std::min(n, room);
+    last.length += take;
+    n -= take;
+  }
+  while (n > 0) {
+    auto take = static_cast<uint32_t>(std::min<size_t>(n, std::numeric_limits<uint32_t>::max()));
+    run_list.push_back({take, level});
+    n -= take;
+  }
+}
+
+void RleWave::append_runs(const Run* runs, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    append(runs[i].level, runs[i].length);
+  }
+}
+
+void RleWave::clear() {
+  run_list.clear();
+  n_samples = 0;
+}
+
+void RleWave::truncate(size_t n_runs) {
+  for (size_t i = n_runs; i < run_list.size(); ++i) {
+    n_samples -= run_list[i].length;
+  }
+  if (n_runs < run_list.size()) {
+    run_list.resize(n_runs);
+  }
+}
+
+template <typename T>
+std::vector<T> RleWave::expand() const {
+  std::vector<T> result(n_samples);
+  auto it = result.begin();
+  for (auto& run : run_list) {
+    it = std::fill_n(it, run.length, static_cast<T>(run.level));
+  }
+  return result;
+}
+
+template std::vector<uint8_t> RleWave::expand<uint8_t>() const;
+template std::vector<int16_t> RleWave::expand<int16_t>() const;
+template std::vector<float> RleWave::expand<float>() const;
+
+void RleSink::write(const uint8_t* levels, size_t n) {
+  size_t i = 0;
+  while (i < n) {
+    size_t j = i + 1;
+    while (j < n && levels[j] == levels[i]) {
+      ++j;
+    }
+    out.append(levels[i], j - i);
+    i = j;
+  }
+}
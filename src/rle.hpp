@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sink.hpp"
+
+// Piecewise-constant waveform stored as runs of (level, length). A PIE
+// command costs a few runs per bit regardless of the sample rate; dense
+// samples are only produced when the wave is expanded at the output.
+class RleWave {
+ public:
+  // Append n samples of level, merging with the last run when possible.
+  void append(uint8_t level, size_t n);
+  void append_runs(const Run* runs, size_t n);
+  void append(const RleWave& other) { append_runs(other.run_list.data(), other.run_list.size()); }
+
+  const std::vector<Run>& runs() const { return run_list; }
+  // Number of samples, not runs.
+  size_t size() const { return n_samples; }
+  bool empty() const { return n_samples == 0; }
+  void clear();
+  // Keep only the first n_runs runs (no-op if there are fewer).
+  void truncate(size_t n_runs);
+
+  // Stream the wave into a sink without materializing it.
+  void expand_to(WaveSink& sink) const { sink.write_runs(run_list.data(), run_list.size()); }
+  template <typename T>
+  std::vector<T> expand() const;
+
+ private:
+  std::vector<Run> run_list;
+  size_t n_samples = 0;
+};
+
+// Collects whatever is written into an RleWave; dense input is run-length
+// encoded on the way in.
+class RleSink : public WaveSink {
+ public:
+  explicit RleSink(RleWave& out) : out(out) {}
+
+  void write(const uint8_t* levels, size_t n) override;
+  void fill(uint8_t level, size_t n) override { out.append(level, n); }
+  void write_runs(const Run* runs, size_t n) override { out.append_runs(runs, n); }
+
+ private:
+  RleWave& out;
+};
@@ -0,0 +1,59 @@
+#include "select_batch.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#include "crc/crc.hpp"
+
+SelectBatch::SelectBatch(const RFIDReaderCommand* reader, int pointer, bool trunc, target_t target, uint8_t action,
+                         membank_t mem_bank)
+    : reader(reader), trunc(trunc) {
+  // An empty-mask Select is header, 8-bit length, trunc and CRC-16.
+  header = RFIDReaderCommand::select_bits(pointer, 0, BitBuffer(), trunc, target, action, mem_bank);
+  header.truncate(header.size() - 8 - 1 - 16);
+
+  RleSink rle(wave);
+  pie_phase_t phase = pie_phase_start;
+  reader->encoder().frame_sync(rle, phase);
+  sync_runs = wave.runs().size();
+  phase_at.push_back(phase);
+  crc_at.push_back(crc16_init);
+}
+
+void SelectBatch::append(WaveSink& sink, const BitBuffer& mask) {
+  if (mask.size() > 255) {
+    throw std::invalid_argument("Mask length must be at most 255 bits.");
+  }
+  scratch = header;
+  scratch.append(mask.size(), 8);
+  scratch.append(mask);
+  scratch.push_back(trunc ? 1 : 0);
+
+  size_t keep = frame.common_prefix(scratch);
+  std::swap(frame, scratch);
+
+  wave.truncate(sync_runs + 2 * keep);
+  phase_at.resize(keep + 1);
+  RleSink rle(wave);
+  pie_phase_t phase = phase_at.back();
+  for (size_t i = keep; i < frame.size(); ++i) {
+    reader->encoder().encode(rle, frame, i, i + 1, phase);
+    phase_at.push_back(phase);
+  }
+  n_encoded = frame.size() - keep;
+
+  // Resume the CRC from the last whole byte of the shared prefix.
+  // crc16genibus_comb() cannot be used here: it combines the CRCs of two
+  // independently checksummed byte strings, while frames diverge at
+  // arbitrary bits and the suffix has no CRC of its own to combine.
+  crc_at.resize(keep / 8 + 1);
+  for (size_t k = crc_at.size() - 1; k < frame.size() / 8; ++k) {
+    crc_at.push_back(crc16(frame.data(), 8 * k, 8, crc_at[k]));
+  }
+  uint16_t crc = crc16(frame.data(), frame.size() / 8 * 8, frame.size() % 8, crc_at.back());
+
+  BitBuffer tail;
+  tail.append(crc, 16);
+  wave.expand_to(sink);
+  reader->encoder().encode(sink, tail, 0, tail.size(), phase);
+}
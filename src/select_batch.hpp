@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bits.hpp"
+#include "reader.hpp"
+#include "rle.hpp"
+#include "sink.hpp"
+
+// Generates a long series of Select commands that differ only in their mask,
+// such as one per EPC of a tag list or the masks of a tree-walking
+// singulation. The PIE waveform and the CRC-16 register of the previous
+// frame are kept; for each new mask only the bits after the first one that
+// differs from the previous frame are encoded again, plus the CRC tail. Feed
+// masks in sorted order to make neighbouring frames share long prefixes; any
+// order gives the same output as RFIDReaderCommand::select().
+class SelectBatch {
+ public:
+  SelectBatch(const RFIDReaderCommand* reader, int pointer = 0, bool trunc = false, target_t target = target_t::SL,
+              uint8_t action = 0, membank_t mem_bank = membank_t::FILE_TYPE);
+
+  // Append the Select for mask (at most 255 bits, length = mask.size()).
+  void append(WaveSink& sink, const BitBuffer& mask);
+
+  // Frame bits encoded again by the last append(), for profiling.
+  size_t last_encoded_bits() const { return n_encoded; }
+
+ private:
+  const RFIDReaderCommand* reader;
+  bool trunc;
+  // Command, target, action, membank and pointer fields.
+  BitBuffer header;
+  // Header, length, mask and trunc of the previous frame (no CRC).
+  BitBuffer frame;
+  BitBuffer scratch;
+  // crc_at[k] is the CRC-16 register after the first k bytes of frame.
+  std::vector<uint16_t> crc_at;
+  // Frame-sync followed by the PIE symbols of frame, two runs per bit.
+  RleWave wave;
+  // phase_at[i] is the encoder phase before bit i of frame.
+  std::vector<pie_phase_t> phase_at;
+  size_t sync_runs;
+  size_t n_encoded = 0;
+};
@@ -0,0 +1,170 @@
+#include "sequencer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+InventorySequencer::InventorySequencer(const RFIDReaderCommand* reader) : reader(reader), table(reader) {}
+
+double InventorySequencer::reply_duration(int n_bits, miller_t m, bool trext) const {
+  int n_symbol_cycles = 1;
+  int n_preamble = trext ? 18 : 6;
+  switch (m) {
+    case miller_t::M1:
+      break;
+    case miller_t::M2:
+      n_symbol_cycles = 2;
+      break;
+    case miller_t::M4:
+      n_symbol_cycles = 4;
+      break;
+    case miller_t::M8:
+      n_symbol_cycles = 8;
+      break;
+  }
+  if (m != miller_t::M1) {
+    n_preamble = trext ? 22 : 10;
+  }
+  return (n_preamble + n_bits + 1) * n_symbol_cycles / reader->link_frequency();
+}
+
+size_t InventorySequencer::samples(double seconds) const {
+  return static_cast<size_t>(std::llround(seconds * reader->encoder().sample_rate()));
+}
+
+void InventorySequencer::run(WaveSink& sink, const InventoryRound& round) const {
+  double rtcal = reader->encoder().rtcal();
+  double tpri = 1.0 / reader->link_frequency();
+  double t1 = round.timing.t1 > 0 ? round.timing.t1 : std::max(rtcal, 10 * tpri);
+  double t2 = round.timing.t2 > 0 ? round.timing.t2 : 3 * tpri;
+  double t4 = round.timing.t4 > 0 ? round.timing.t4 : 2 * rtcal;
+
+  miller_t m = miller_t::M1;
+  bool trext = false;
+  for (auto& step : round.steps) {
+    if (step.command) {
+      auto& command = *step.command;
+      table.generate(command, sink);
+      if (command.command == command_t::QUERY) {
+        m = command.miller;
+        trext = command.trext;
+      }
+
+      double gap = t4;
+      switch (step.reply) {
+        case reply_t::NONE:
+          break;
+        case reply_t::RN16:
+          gap = t1 + reply_duration(16, m, trext) + t2;
+          break;
+        case reply_t::EPC:
+          gap = t1 + reply_duration(16 + round.epc_length + 16, m, trext) + t2;
+          break;
+      }
+      sink.fill(1, samples(gap));
+    }
+    sink.fill(1, samples(step.cw));
+  }
+}
+
+static double parse_us(const std::string& key, const std::string& value) {
+  try {
+    size_t pos = 0;
+    double us = std::stod(value, &pos);
+    if (pos == value.size() && us >= 0) {
+      return us * 1e-6;
+    }
+  } catch (const std::logic_error&) {
+  }
+  throw std::invalid_argument("Invalid duration for '" + key + "': " + value);
+}
+
+InventoryRound parse_inventory_round(std::istream& in) {
+  InventoryRound round;
+  std::string line;
+  int line_no = 0;
+  while (std::getline(in, line)) {
+    ++line_no;
+    auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    auto last = line.find_last_not_of(" \t\r");
+    line = line.substr(first, last - first + 1);
+
+    try {
+      std::vector<std::pair<std::string, std::string>> options;
+      std::string head = line.substr(0, line.find(','));
+      std::string command;
+      size_t start = 0;
+      while (start != std::string::npos) {
+        auto end = line.find(',', start);
+        auto field = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        start = end == std::string::npos ? end : end + 1;
+        auto eq = field.find('=');
+        auto key = field.substr(0, eq);
+        auto value = eq == std::string::npos ? std::string() : field.substr(eq + 1);
+        if (head != "timing" && head != "epc" && head != "cw" && key != "reply" && key != "cw") {
+          command += command.empty() ? field : "," + field;
+        } else if (eq != std::string::npos) {
+          options.emplace_back(key, value);
+        }
+      }
+
+      RoundStep step;
+      if (head == "timing") {
+        for (auto& [key, value] : options) {
+          if (key == "t1") {
+            round.timing.t1 = parse_us(key, value);
+          } else if (key == "t2") {
+            round.timing.t2 = parse_us(key, value);
+          } else if (key == "t4") {
+            round.timing.t4 = parse_us(key, value);
+          } else {
+            throw std::invalid_argument("Unknown option '" + key + "'");
+          }
+        }
+        continue;
+      } else if (head == "epc") {
+        for (auto& [key, value] : options) {
+          if (key != "length") {
+            throw std::invalid_argument("Unknown option '" + key + "'");
+          }
+          // The PC length field counts at most 31 words.
+          round.epc_length = parse_int(key, value);
+          if (round.epc_length < 0 || round.epc_length > 31 * 16) {
+            throw std::invalid_argument("EPC length must be in 0..496 bits: " + value);
+          }
+        }
+        continue;
+      } else if (head == "cw") {
+        for (auto& [key, value] : options) {
+          if (key != "duration") {
+            throw std::invalid_argument("Unknown option '" + key + "'");
+          }
+          step.cw = parse_us(key, value);
+        }
+      } else {
+        step.command = parse_command_spec(command, false);
+        for (auto& [key, value] : options) {
+          if (key == "cw") {
+            step.cw = parse_us(key, value);
+          } else if (value == "none") {
+            step.reply = reply_t::NONE;
+          } else if (value == "rn16") {
+            step.reply = reply_t::RN16;
+          } else if (value == "epc") {
+            step.reply = reply_t::EPC;
+          } else {
+            throw std::invalid_argument("Invalid value for 'reply': " + value);
+          }
+        }
+      }
+      round.steps.push_back(std::move(step));
+    } catch (const std::exception& e) {
+      throw std::invalid_argument("line " + std::to_string(line_no) + ": " + e.what());
+    }
+  }
+  return round;
+}
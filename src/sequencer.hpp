@@ -0,0 +1,70 @@
+#pragma once
+
+#include <istream>
+#include <optional>
+#include <vector>
+
+#include "command_table.hpp"
+#include "reader.hpp"
+#include "sink.hpp"
+#include "spec.hpp"
+
+// Tag reply the reader keeps the carrier up for after a command.
+enum class reply_t { NONE, RN16, EPC };
+
+// Gen2 link timing in seconds. A zero field takes its nominal value:
+// T1 = max(RTcal, 10 Tpri), T2 = 3 Tpri and T4 = 2 RTcal, where
+// Tpri = 1 / BLF.
+struct LinkTiming {
+  double t1 = 0;
+  double t2 = 0;
+  double t4 = 0;
+};
+
+// A command followed by its link-timing gap, or a plain CW interval when
+// command is empty. cw adds extra carrier after the gap.
+struct RoundStep {
+  std::optional<CommandSpec> command;
+  reply_t reply = reply_t::NONE;
+  double cw = 0;
+};
+
+struct InventoryRound {
+  LinkTiming timing;
+  // EPC length in bits, used for the duration of EPC replies (PC and CRC
+  // are added on top).
+  int epc_length = 96;
+  std::vector<RoundStep> steps;
+};
+
+// Emits a whole inventory round (Select, Query, QueryRep, QueryAdjust, Ack,
+// ...) as one continuous waveform. The carrier stays up (level 1) during
+// the gaps: T4 after a command without reply, and T1 + reply + T2 after a
+// command that the tag answers. Reply durations follow the Miller mode and
+// TRext of the most recent Query. Query, QueryRep and QueryAdjust come from
+// a CommandTable, so a round with thousands of QueryReps encodes each
+// variant once.
+class InventorySequencer {
+ public:
+  explicit InventorySequencer(const RFIDReaderCommand* reader);
+
+  void run(WaveSink& sink, const InventoryRound& round) const;
+
+  // Duration of a tag reply of n_bits data bits in seconds, including the
+  // preamble and the trailing dummy bit.
+  double reply_duration(int n_bits, miller_t m, bool trext) const;
+
+ private:
+  size_t samples(double seconds) const;
+
+  const RFIDReaderCommand* reader;
+  CommandTable table;
+};
+
+// Parse a round description, one step per line:
+//   timing,t1=<us>,t2=<us>,t4=<us>
+//   epc,length=<bits>
+//   cw,duration=<us>
+//   <command spec without out=>[,reply=none|rn16|epc][,cw=<us>]
+// Blank lines and lines starting with '#' are ignored.
+InventoryRound parse_inventory_round(std::istream& in);
@@ -0,0 +1,158 @@
+#include "shaper.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+static constexpr double pi = 3.14159265358979323846;
+
+// Step response at time t (in samples) from the transition instant.
+static double step_response(double t, double rise, edge_shape_t shape) {
+  switch (shape) {
+    case edge_shape_t::LINEAR:
+      return std::clamp(t / rise + 0.5, 0.0, 1.0);
+    case edge_shape_t::RAISED_COSINE: {
+      double x = std::clamp(t / rise + 0.5, 0.0, 1.0);
+      return 0.5 - 0.5 * std::cos(pi * x);
+    }
+    case edge_shape_t::GAUSSIAN: {
+      // 10..90 % of a Gaussian edge spans 2 * 1.2816 sigma.
+      double sigma = rise / 2.5631;
+      return 0.5 * (1 + std::erf(t / (sigma * std::sqrt(2.0))));
+    }
+  }
+  return t >= 0;
+}
+
+PulseShaper::PulseShaper(double samp_rate, double rise_time, edge_shape_t shape) {
+  if (samp_rate <= 0 || rise_time <= 0) {
+    throw std::invalid_argument("Pulse shaper needs a positive sample rate and rise time.");
+  }
+  double rise = rise_time * samp_rate;
+  double half = shape == edge_shape_t::GAUSSIAN ? 3 * rise / 2.5631 : rise / 2;
+  r = static_cast<size_t>(std::ceil(half)) + 1;
+
+  corrections.resize(2 * r);
+  for (size_t k = 0; k < 2 * r; ++k) {
+    auto j = static_cast<ptrdiff_t>(k) - static_cast<ptrdiff_t>(r);
+    // The ideal transition lies between samples -1 and 0.
+    double t = j + 0.5;
+    corrections[k] = static_cast<float>(step_response(t, rise, shape) - (j >= 0));
+  }
+}
+
+void PulseShaper::add_edge(float* out, size_t n, ptrdiff_t pos, float delta) const {
+  const float* row = corrections.data();
+  auto begin = std::max<ptrdiff_t>(pos - static_cast<ptrdiff_t>(r), 0);
+  auto end = std::min<ptrdiff_t>(pos + static_cast<ptrdiff_t>(r), static_cast<ptrdiff_t>(n));
+  const float* taps = row + (begin - (pos - static_cast<ptrdiff_t>(r)));
+  float* dst = out + begin;
+  for (ptrdiff_t i = 0; i < end - begin; ++i) {
+    dst[i] += delta * taps[i];
+  }
+}
+
+void PulseShaper::shape(const Run* runs, size_t n_runs, float* out) const {
+  size_t n = 0;
+  for (size_t i = 0; i < n_runs; ++i) {
+    std::fill_n(out + n, runs[i].length, static_cast<float>(runs[i].level));
+    n += runs[i].length;
+  }
+  size_t pos = 0;
+  for (size_t i = 1; i < n_runs; ++i) {
+    pos += runs[i - 1].length;
+    float delta = static_cast<float>(runs[i].level) - static_cast<float>(runs[i - 1].level);
+    if (delta != 0) {
+      add_edge(out, n, pos, delta);
+    }
+  }
+}
+
+std::vector<float> PulseShaper::shape(const RleWave& wave) const {
+  std::vector<float> result(wave.size());
+  shape(wave.runs().data(), wave.runs().size(), result.data());
+  return result;
+}
+
+ShapingSink::ShapingSink(const PulseShaper& shaper, FileSink& out, size_t block)
+    : shaper(shaper), out(out), block(std::max(block, 2 * shaper.radius())) {}
+
+void ShapingSink::write(const uint8_t* levels, size_t n) {
+  RleSink(pending).write(levels, n);
+  if (pending.size() >= block + 2 * shaper.radius()) {
+    process(false);
+  }
+}
+
+void ShapingSink::fill(uint8_t level, size_t n) {
+  pending.append(level, n);
+  if (pending.size() >= block + 2 * shaper.radius()) {
+    process(false);
+  }
+}
+
+void ShapingSink::write_runs(const Run* runs, size_t n) {
+  pending.append_runs(runs, n);
+  if (pending.size() >= block + 2 * shaper.radius()) {
+    process(false);
+  }
+}
+
+void ShapingSink::finish() { process(true); }
+
+void ShapingSink::process(bool final) {
+  size_t n = pending.size();
+  size_t r = shaper.radius();
+  if (n == 0 || (!final && n < 2 * r)) {
+    return;
+  }
+  // The last r samples still depend on edges that have not arrived yet.
+  size_t end = final ? n : n - r;
+
+  // Samples [pos, stop) only see edges in [pos - r, stop + r), so each pass
+  // shapes the runs clipped to that range.
+  auto& runs = pending.runs();
+  size_t run = 0;
+  uint64_t run_start = 0;
+  for (size_t pos = skip; pos < end;) {
+    size_t stop = std::min(end, pos + block);
+    size_t lo = pos >= r ? pos - r : 0;
+    size_t hi = std::min(n, stop + r);
+    while (run_start + runs[run].length <= lo) {
+      run_start += runs[run].length;
+      ++run;
+    }
+    window.clear();
+    uint64_t start = run_start;
+    for (size_t i = run; start < hi; start += runs[i].length, ++i) {
+      uint64_t a = std::max<uint64_t>(start, lo);
+      uint64_t b = std::min<uint64_t>(start + runs[i].length, hi);
+      if (b > a) {
+        window.push_back({static_cast<uint32_t>(b - a), runs[i].level});
+      }
+    }
+    envelope.resize(hi - lo);
+    shaper.shape(window.data(), window.size(), envelope.data());
+    out.write_envelope(envelope.data() + (pos - lo), stop - pos);
+    pos = stop;
+  }
+  if (final) {
+    pending.clear();
+    skip = 0;
+    return;
+  }
+
+  // Keep the runs covering the last 2 r samples. An edge at the cut only
+  // affects samples before n - r, which are written already.
+  size_t kept = 0;
+  size_t first = runs.size();
+  while (kept < 2 * r) {
+    --first;
+    kept += runs[first].length;
+  }
+  RleWave tail;
+  tail.append(runs[first].level, runs[first].length - (kept - 2 * r));
+  tail.append_runs(runs.data() + first + 1, runs.size() - first - 1);
+  pending = std::move(tail);
+  skip = r;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "io.hpp"
+#include "rle.hpp"
+#include "sink.hpp"
+
+// Edge profile of the shaped envelope. rise_time is the full 0..100 %
+// transition for LINEAR and RAISED_COSINE and the 10..90 % rise time of the
+// Gaussian (erf) edge.
+enum class edge_shape_t { LINEAR, RAISED_COSINE, GAUSSIAN };
+
+// Band-limits PIE levels into a float envelope (0 at level 0, 1 at level 1).
+//
+// Filtering a piecewise-constant signal with a FIR of step response S gives
+// the ideal levels plus, at every edge, delta * (S - unit step) over the
+// filter span. The shaper stores that correction once and adds it around
+// each edge, so flat stretches are plain fills and the filter work is
+// proportional to the number of edges, not samples. Nearby edges superpose
+// exactly as in the full convolution. Edges sit on sample boundaries, as
+// the levels carry no sub-sample timing.
+class PulseShaper {
+ public:
+  PulseShaper(double samp_rate, double rise_time, edge_shape_t shape = edge_shape_t::RAISED_COSINE);
+
+  // Samples an edge affects on either side.
+  size_t radius() const { return r; }
+
+  // Write the envelope of n_runs runs to out, which must hold all of their
+  // samples. Levels before the first and after the last run are taken to
+  // continue unchanged.
+  void shape(const Run* runs, size_t n_runs, float* out) const;
+  std::vector<float> shape(const RleWave& wave) const;
+
+  // Add the correction for a step of delta whose first sample at the new
+  // level is pos to out[0, n).
+  void add_edge(float* out, size_t n, ptrdiff_t pos, float delta) const;
+
+ private:
+  size_t r;
+  // 2 * r taps for offsets -r .. r - 1 from the edge.
+  std::vector<float> corrections;
+};
+
+// Shapes everything written to it and streams the envelope to a FileSink.
+// Levels are collected as runs and shaped at most block samples at a time,
+// from the runs within radius() of them, so memory does not depend on the
+// length of a run (a long CW gap is one run). The last 2 * radius() samples
+// are kept so edges near the end see both sides. Call finish() before
+// closing the file.
+class ShapingSink : public WaveSink {
+ public:
+  ShapingSink(const PulseShaper& shaper, FileSink& out, size_t block = 1 << 16);
+
+  void write(const uint8_t* levels, size_t n) override;
+  void fill(uint8_t level, size_t n) override;
+  void write_runs(const Run* runs, size_t n) override;
+
+  // Shape and write the remaining samples.
+  void finish();
+
+ private:
+  void process(bool final);
+
+  const PulseShaper& shaper;
+  FileSink& out;
+  size_t block;
+  RleWave pending;
+  // Leading samples of pending that have already been written.
+  size_t skip = 0;
+  // Runs of the samples shaped in one pass, and their envelope.
+  std::vector<Run> window;
+  std::vector<float> envelope;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A run of identical levels.
+struct Run {
+  uint32_t length;
+  uint8_t level;
+};
+
+// Destination for PIE levels (0 or 1). Encoders append preamble, frame-sync
+// and data symbols to a sink in order, so a command never has to be built in
+// a temporary and spliced; the sink decides whether samples are buffered,
+// converted or streamed to disk.
+class WaveSink {
+ public:
+  virtual ~WaveSink() = default;
+
+  // Append n levels.
+  virtual void write(const uint8_t* levels, size_t n) = 0;
+  // Append n copies of level.
+  virtual void fill(uint8_t level, size_t n) = 0;
+  // Append n runs. Dense sinks expand them with fill().
+  virtual void write_runs(const Run* runs, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      fill(runs[i].level, runs[i].length);
+    }
+  }
+};
+
+// Appends samples to a caller-owned vector.
+template <typename T>
+class VectorSink : public WaveSink {
+ public:
+  explicit VectorSink(std::vector<T>& out) : out(out) {}
+
+  void write(const uint8_t* levels, size_t n) override { out.insert(out.end(), levels, levels + n); }
+  void fill(uint8_t level, size_t n) override { out.insert(out.end(), n, static_cast<T>(level)); }
+
+ private:
+  std::vector<T>& out;
+};
@@ -0,0 +1,325 @@
+#include "spec.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+static std::string to_upper(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::toupper(c); });
+  return s;
+}
+
+int parse_int(const std::string& key, const std::string& value) {
+  try {
+    size_t pos = 0;
+    int result = std::stoi(value, &pos, 0);
+    if (pos == value.size()) {
+      return result;
+    }
+  } catch (const std::logic_error&) {
+  }
+  throw std::invalid_argument("Invalid integer for '" + key + "': " + value);
+}
+
+double parse_double(const std::string& key, const std::string& value) {
+  try {
+    size_t pos = 0;
+    double result = std::stod(value, &pos);
+    if (pos == value.size() && std::isfinite(result)) {
+      return result;
+    }
+  } catch (const std::logic_error&) {
+  }
+  throw std::invalid_argument("Invalid number for '" + key + "': " + value);
+}
+
+bool parse_bool(const std::string& key, const std::string& value) {
+  auto v = to_upper(value);
+  if (v == "1" || v == "TRUE" || v == "YES") {
+    return true;
+  }
+  if (v == "0" || v == "FALSE" || v == "NO") {
+    return false;
+  }
+  throw std::invalid_argument("Invalid boolean for '" + key + "': " + value);
+}
+
+template <typename T>
+static T parse_enum(const std::string& key, const std::string& value, const std::map<std::string, T>& names) {
+  auto it = names.find(to_upper(value));
+  if (it == names.end()) {
+    throw std::invalid_argument("Invalid value for '" + key + "': " + value);
+  }
+  return it->second;
+}
+
+template <typename T>
+static std::string enum_name(T value, const std::map<std::string, T>& names) {
+  for (auto& [name, v] : names) {
+    if (v == value) {
+      return name;
+    }
+  }
+  throw std::invalid_argument("Value has no name.");
+}
+
+static const std::map<std::string, command_t> command_names = {
+    {"SELECT", command_t::SELECT},           {"QUERY", command_t::QUERY}, {"QUERYREP", command_t::QUERY_REP},
+    {"QUERYADJUST", command_t::QUERY_ADJUST}, {"ACK", command_t::ACK},
+};
+
+static const std::map<std::string, target_t> target_names = {
+    {"INV_S0", target_t::INV_S0}, {"INV_S1", target_t::INV_S1}, {"INV_S2", target_t::INV_S2},
+    {"INV_S3", target_t::INV_S3}, {"SL", target_t::SL},
+};
+
+static const std::map<std::string, membank_t> membank_names = {
+    {"FILE_TYPE", membank_t::FILE_TYPE},
+    {"EPC", membank_t::EPC},
+    {"TID", membank_t::TID},
+    {"FILE_0", membank_t::FILE_0},
+};
+
+static const std::map<std::string, dr_t> dr_names = {{"8", dr_t::DR_8}, {"64/3", dr_t::DR_64_3}};
+
+static const std::map<std::string, miller_t> miller_names = {
+    {"1", miller_t::M1}, {"2", miller_t::M2}, {"4", miller_t::M4}, {"8", miller_t::M8}};
+
+static const std::map<std::string, sel_t> sel_names = {
+    {"ALL", sel_t::ALL}, {"SL", sel_t::SL}, {"NOT_SL", sel_t::NOT_SL}};
+
+static const std::map<std::string, session_t> session_names = {
+    {"S0", session_t::S0}, {"S1", session_t::S1}, {"S2", session_t::S2}, {"S3", session_t::S3}};
+
+static const std::map<std::string, inventory_t> inventory_names = {{"A", inventory_t::A}, {"B", inventory_t::B}};
+
+static const std::map<std::string, updn_t> updn_names = {
+    {"0", updn_t::UNCHANGED}, {"+1", updn_t::INCREACE}, {"-1", updn_t::DECREASE}};
+
+static void set_field(CommandSpec& spec, const std::string& key, const std::string& value) {
+  if (key == "out") {
+    spec.output = value;
+    return;
+  }
+
+  switch (spec.command) {
+    case command_t::SELECT:
+      if (key == "pointer") {
+        spec.pointer = parse_int(key, value);
+      } else if (key == "length") {
+        spec.length = parse_int(key, value);
+      } else if (key == "mask") {
+        spec.mask = hex_to_bits(value);
+      } else if (key == "trunc") {
+        spec.trunc = parse_bool(key, value);
+      } else if (key == "target") {
+        spec.target = parse_enum(key, value, target_names);
+      } else if (key == "action") {
+        auto action = parse_int(key, value);
+        if (action < 0 || action > 7) {
+          throw std::invalid_argument("Action must be in 0..7: " + value);
+        }
+        spec.action = action;
+      } else if (key == "membank") {
+        spec.mem_bank = parse_enum(key, value, membank_names);
+      } else {
+        break;
+      }
+      return;
+    case command_t::QUERY:
+      if (key == "dr") {
+        spec.dr = parse_enum(key, value, dr_names);
+      } else if (key == "m") {
+        spec.miller = parse_enum(key, value, miller_names);
+      } else if (key == "trext") {
+        spec.trext = parse_bool(key, value);
+      } else if (key == "sel") {
+        spec.sel = parse_enum(key, value, sel_names);
+      } else if (key == "session") {
+        spec.session = parse_enum(key, value, session_names);
+      } else if (key == "target") {
+        spec.inventory = parse_enum(key, value, inventory_names);
+      } else if (key == "q") {
+        spec.q = parse_int(key, value);
+        if (spec.q < 0 || spec.q > 15) {
+          throw std::invalid_argument("Q must be in 0..15: " + value);
+        }
+      } else {
+        break;
+      }
+      return;
+    case command_t::QUERY_REP:
+      if (key == "session") {
+        spec.session = parse_enum(key, value, session_names);
+        return;
+      }
+      break;
+    case command_t::QUERY_ADJUST:
+      if (key == "session") {
+        spec.session = parse_enum(key, value, session_names);
+      } else if (key == "updn") {
+        spec.updn = parse_enum(key, value, updn_names);
+      } else {
+        break;
+      }
+      return;
+    case command_t::ACK:
+      if (key == "rn16") {
+        spec.rn16 = bin_to_bits(value);
+        return;
+      }
+      break;
+  }
+  throw std::invalid_argument("Unknown option '" + key + "'");
+}
+
+CommandSpec parse_command_spec(const std::string& spec, bool require_output) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  while (true) {
+    auto end = spec.find(',', start);
+    fields.push_back(spec.substr(start, end - start));
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+
+  CommandSpec result;
+  result.command = parse_enum("command", fields[0], command_names);
+  for (size_t i = 1; i < fields.size(); ++i) {
+    auto eq = fields[i].find('=');
+    if (eq == std::string::npos) {
+      throw std::invalid_argument("Expected key=value, got '" + fields[i] + "'");
+    }
+    set_field(result, fields[i].substr(0, eq), fields[i].substr(eq + 1));
+  }
+
+  if (require_output && result.output.empty()) {
+    throw std::invalid_argument("Missing out=<path> in '" + spec + "'");
+  }
+  if (result.command == command_t::SELECT && result.length < 0) {
+    result.length = result.mask.size();
+  }
+  if (result.command == command_t::ACK && result.rn16.size() != 16) {
+    throw std::invalid_argument("RN16 must be 16 bits long.");
+  }
+  return result;
+}
+
+std::string format_command_spec(const CommandSpec& spec) {
+  auto command = enum_name(spec.command, command_names);
+  std::transform(command.begin(), command.end(), command.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  std::string out = command;
+  auto field = [&out](const std::string& key, const std::string& value) { out += "," + key + "=" + value; };
+
+  switch (spec.command) {
+    case command_t::SELECT:
+      field("pointer", std::to_string(spec.pointer));
+      field("length", std::to_string(spec.length));
+      field("mask", bits_to_hex(spec.mask));
+      field("trunc", spec.trunc ? "1" : "0");
+      field("target", enum_name(spec.target, target_names));
+      field("action", std::to_string(spec.action));
+      field("membank", enum_name(spec.mem_bank, membank_names));
+      break;
+    case command_t::QUERY:
+      field("dr", enum_name(spec.dr, dr_names));
+      field("m", enum_name(spec.miller, miller_names));
+      field("trext", spec.trext ? "1" : "0");
+      field("sel", enum_name(spec.sel, sel_names));
+      field("session", enum_name(spec.session, session_names));
+      field("target", enum_name(spec.inventory, inventory_names));
+      field("q", std::to_string(spec.q));
+      break;
+    case command_t::QUERY_REP:
+      field("session", enum_name(spec.session, session_names));
+      break;
+    case command_t::QUERY_ADJUST:
+      field("session", enum_name(spec.session, session_names));
+      field("updn", enum_name(spec.updn, updn_names));
+      break;
+    case command_t::ACK:
+      field("rn16", bits_to_bin(spec.rn16));
+      break;
+  }
+  if (!spec.output.empty()) {
+    field("out", spec.output);
+  }
+  return out;
+}
+
+void generate_command(const RFIDReaderCommand& reader, const CommandSpec& spec, WaveSink& sink) {
+  switch (spec.command) {
+    case command_t::SELECT:
+      if (spec.length > 255) {
+        throw std::invalid_argument("Mask length must be at most 255 bits.");
+      }
+      reader.select(sink, spec.pointer, spec.length, spec.mask, spec.trunc, spec.target, spec.action,
+                    spec.mem_bank);
+      break;
+    case command_t::QUERY:
+      reader.query(sink, spec.dr, spec.miller, spec.trext, spec.sel, spec.session, spec.inventory, spec.q);
+      break;
+    case command_t::QUERY_REP:
+      reader.query_rep(sink, spec.session);
+      break;
+    case command_t::QUERY_ADJUST:
+      reader.query_adjust(sink, spec.session, spec.updn);
+      break;
+    case command_t::ACK:
+      reader.ack(sink, spec.rn16);
+      break;
+  }
+}
+
+BitBuffer hex_to_bits(const std::string& hex) {
+  BitBuffer bits;
+  for (char c : hex) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      continue;
+    }
+    if (!std::isxdigit(static_cast<unsigned char>(c))) {
+      throw std::invalid_argument("Invalid hex digit: " + std::string(1, c));
+    }
+    bits.append(std::stoi(std::string(1, c), nullptr, 16), 4);
+  }
+  return bits;
+}
+
+BitBuffer bin_to_bits(const std::string& bin) {
+  BitBuffer bits;
+  for (char c : bin) {
+    if (c == '0' || c == '1') {
+      bits.push_back(c == '1');
+    } else if (!std::isspace(static_cast<unsigned char>(c))) {
+      throw std::invalid_argument("Invalid binary digit: " + std::string(1, c));
+    }
+  }
+  return bits;
+}
+
+std::string bits_to_hex(const BitBuffer& bits) {
+  static const char digits[] = "0123456789ABCDEF";
+  std::string hex;
+  for (size_t i = 0; i < bits.size(); i += 4) {
+    int digit = 0;
+    for (size_t j = i; j < i + 4; ++j) {
+      digit = digit << 1 | (j < bits.size() ? bits[j] : 0);
+    }
+    hex.push_back(digits[digit]);
+  }
+  return hex;
+}
+
+std::string bits_to_bin(const BitBuffer& bits) {
+  std::string bin;
+  for (size_t i = 0; i < bits.size(); ++i) {
+    bin.push_back(bits[i] ? '1' : '0');
+  }
+  return bin;
+}
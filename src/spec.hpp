@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "reader.hpp"
+
+// A single command to generate, as given on the epcphy-cli command line:
+//   <command>[,key=value]...,out=<path>
+// e.g. "query,dr=64/3,m=4,q=3,out=query.cf32".
+struct CommandSpec {
+  command_t command = command_t::QUERY;
+  std::string output;
+
+  // Select
+  int pointer = 0;
+  int length = -1;
+  BitBuffer mask;
+  bool trunc = false;
+  target_t target = target_t::SL;
+  uint8_t action = 0;
+  membank_t mem_bank = membank_t::FILE_TYPE;
+
+  // Query, QueryRep, QueryAdjust
+  dr_t dr = dr_t::DR_8;
+  miller_t miller = miller_t::M1;
+  bool trext = false;
+  sel_t sel = sel_t::ALL;
+  session_t session = session_t::S0;
+  inventory_t inventory = inventory_t::A;
+  int q = 0;
+  updn_t updn = updn_t::UNCHANGED;
+
+  // Ack
+  BitBuffer rn16;
+};
+
+CommandSpec parse_command_spec(const std::string& spec, bool require_output = true);
+// Inverse of parse_command_spec(): every field of the command, plus out= when
+// an output is set.
+std::string format_command_spec(const CommandSpec& spec);
+void generate_command(const RFIDReaderCommand& reader, const CommandSpec& spec, WaveSink& sink);
+
+// Value of a key=value field: a whole decimal, hex (0x) or octal integer;
+// throws std::invalid_argument naming key otherwise.
+int parse_int(const std::string& key, const std::string& value);
+// Value of a key=value field: a whole finite floating-point number.
+double parse_double(const std::string& key, const std::string& value);
+// Value of a key=value field: 1/true/yes or 0/false/no in any case; throws
+// std::invalid_argument naming key otherwise.
+bool parse_bool(const std::string& key, const std::string& value);
+
+BitBuffer hex_to_bits(const std::string& hex);
+BitBuffer bin_to_bits(const std::string& bin);
+// Hex digits of bits, zero padded to a whole digit.
+std::string bits_to_hex(const BitBuffer& bits);
+std::string bits_to_bin(const BitBuffer& bits);
@@ -0,0 +1,198 @@
+#include "stats.hpp"
+
+#include <cstdio>
+
+#ifdef EPCPHY_STATS
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+static constexpr int n_stages = 4;
+// Slot for allocations made outside any stage.
+static constexpr int other_stage = n_stages;
+static const char* const stage_names[n_stages + 1] = {"bits", "crc", "pie", "write", "other"};
+
+enum { CALLS, NS, SAMPLES, BYTES, N_COUNTERS };
+
+// Written only by the owning thread (plain load + store, no locked add) and
+// read by stats_json() from any thread.
+struct ThreadStats {
+  std::atomic<uint64_t> counters[n_stages][N_COUNTERS] = {};
+
+  ThreadStats();
+  ~ThreadStats();
+
+  void add(int stage, int counter, uint64_t value) {
+    auto& c = counters[stage][counter];
+    c.store(c.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<ThreadStats*> live;
+  // Totals of threads that have exited.
+  uint64_t retired[n_stages][N_COUNTERS] = {};
+};
+
+static Registry& registry() {
+  static Registry instance;
+  return instance;
+}
+
+ThreadStats::ThreadStats() {
+  auto& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.live.push_back(this);
+}
+
+ThreadStats::~ThreadStats() {
+  auto& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (int s = 0; s < n_stages; ++s) {
+    for (int c = 0; c < N_COUNTERS; ++c) {
+      r.retired[s][c] += counters[s][c].load(std::memory_order_relaxed);
+    }
+  }
+  for (auto& entry : r.live) {
+    if (entry == this) {
+      entry = r.live.back();
+      r.live.pop_back();
+      break;
+    }
+  }
+}
+
+static ThreadStats& thread_stats() {
+  thread_local ThreadStats stats;
+  return stats;
+}
+
+// Trivially initialized, so operator new can read them on any thread.
+static thread_local int active_stage = -1;
+static thread_local int64_t active_since = 0;
+static std::atomic<uint64_t> allocations[n_stages + 1];
+static std::atomic<uint64_t> allocated_bytes[n_stages + 1];
+static std::atomic<uint64_t> peak_buffer;
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Charge the time since the last switch to the active stage and make stage
+// the active one.
+static void switch_stage(int stage) {
+  int64_t now = now_ns();
+  if (active_stage >= 0) {
+    thread_stats().add(active_stage, NS, now - active_since);
+  }
+  active_stage = stage;
+  active_since = now;
+}
+
+StageTimer::StageTimer(stage_t stage) : previous(active_stage) {
+  thread_stats().add(static_cast<int>(stage), CALLS, 1);
+  switch_stage(static_cast<int>(stage));
+}
+
+StageTimer::~StageTimer() { switch_stage(previous); }
+
+void stats_count(stage_t stage, uint64_t samples, uint64_t bytes) {
+  auto& stats = thread_stats();
+  stats.add(static_cast<int>(stage), SAMPLES, samples);
+  stats.add(static_cast<int>(stage), BYTES, bytes);
+}
+
+void stats_buffer(uint64_t bytes) {
+  uint64_t peak = peak_buffer.load(std::memory_order_relaxed);
+  while (bytes > peak && !peak_buffer.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+  }
+}
+
+void* operator new(size_t size) {
+  int stage = active_stage >= 0 ? active_stage : other_stage;
+  allocations[stage].fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes[stage].fetch_add(size, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+bool stats_enabled() { return true; }
+
+void stats_reset() {
+  auto& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (int s = 0; s < n_stages; ++s) {
+    for (int c = 0; c < N_COUNTERS; ++c) {
+      r.retired[s][c] = 0;
+      for (auto stats : r.live) {
+        stats->counters[s][c].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+  for (int s = 0; s <= n_stages; ++s) {
+    allocations[s] = 0;
+    allocated_bytes[s] = 0;
+  }
+  peak_buffer = 0;
+}
+
+std::string stats_json() {
+  uint64_t totals[n_stages][N_COUNTERS];
+  {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (int s = 0; s < n_stages; ++s) {
+      for (int c = 0; c < N_COUNTERS; ++c) {
+        totals[s][c] = r.retired[s][c];
+        for (auto stats : r.live) {
+          totals[s][c] += stats->counters[s][c].load(std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+
+  std::string json = "{\n  \"enabled\": true,\n  \"stages\": {\n";
+  char line[320];
+  for (int s = 0; s <= n_stages; ++s) {
+    uint64_t calls = 0, ns = 0, samples = 0, bytes = 0;
+    if (s < n_stages) {
+      calls = totals[s][CALLS];
+      ns = totals[s][NS];
+      samples = totals[s][SAMPLES];
+      bytes = totals[s][BYTES];
+    }
+    std::snprintf(line, sizeof(line),
+                  "    \"%s\": {\"calls\": %llu, \"seconds\": %.6f, \"samples\": %llu, \"bytes\": %llu, "
+                  "\"allocations\": %llu, \"allocated_bytes\": %llu}%s\n",
+                  stage_names[s], static_cast<unsigned long long>(calls), ns * 1e-9,
+                  static_cast<unsigned long long>(samples), static_cast<unsigned long long>(bytes),
+                  static_cast<unsigned long long>(allocations[s].load()),
+                  static_cast<unsigned long long>(allocated_bytes[s].load()), s < n_stages ? "," : "");
+    json += line;
+  }
+  std::snprintf(line, sizeof(line), "  },\n  \"peak_buffer_bytes\": %llu\n}\n",
+                static_cast<unsigned long long>(peak_buffer.load()));
+  return json + line;
+}
+
+#else
+
+bool stats_enabled() { return false; }
+
+void stats_reset() {}
+
+std::string stats_json() { return "{\n  \"enabled\": false\n}\n"; }
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Pipeline instrumentation, compiled in with the EPCPHY_STATS CMake option.
+// Stages are timed exclusively: entering a nested stage (the CRC inside
+// Query bit building, a buffer flush inside PIE expansion) pauses the outer
+// one, so the stage times add up to the instrumented wall time per thread.
+// Counters are per thread and merged when a summary is taken; allocations
+// are counted by replacing the global operator new and charged to the stage
+// running on the allocating thread. Without EPCPHY_STATS the macros expand
+// to nothing and the summary reports "enabled": false.
+enum class stage_t { BITS, CRC, PIE, WRITE };
+
+bool stats_enabled();
+// Zero all counters; call while no instrumented work is running.
+void stats_reset();
+// JSON object with calls, seconds, samples, bytes, allocations and
+// allocated bytes per stage ("other" collects allocations outside any
+// stage), and the largest sample buffer seen.
+std::string stats_json();
+
+#ifdef EPCPHY_STATS
+
+class StageTimer {
+ public:
+  explicit StageTimer(stage_t stage);
+  ~StageTimer();
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+ private:
+  int previous;
+};
+
+void stats_count(stage_t stage, uint64_t samples, uint64_t bytes);
+void stats_buffer(uint64_t bytes);
+
+#define EPCPHY_STAGE(stage) StageTimer epcphy_stage_timer_(stage)
+#define EPCPHY_COUNT(stage, samples, bytes) stats_count(stage, samples, bytes)
+#define EPCPHY_BUFFER(bytes) stats_buffer(bytes)
+
+#else
+
+#define EPCPHY_STAGE(stage) ((void)0)
+#define EPCPHY_COUNT(stage, samples, bytes) ((void)0)
+#define EPCPHY_BUFFER(bytes) ((void)0)
+
+#endif
@@ -0,0 +1,167 @@
+#include "tag.hpp"
+
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+
+#include "crc/crc.hpp"
+
+// FM0 preamble 1 0 1 0 v 1 as half-symbol levels; the fifth symbol violates
+// the boundary inversion.
+static const uint8_t fm0_preamble[] = {1, 1, 0, 1, 0, 0, 1, 0, 0, 0, 1, 1};
+
+TagEncoder::TagEncoder(int samp_rate, double blf, miller_t m, bool trext, timing_t timing)
+    : samp_rate(samp_rate), blf(blf), m(m), trext(trext), timing_mode(timing) {
+  if (blf <= 0) {
+    throw std::invalid_argument("BLF must be positive.");
+  }
+  size_t cycles = 1;
+  switch (m) {
+    case miller_t::M1:
+      break;
+    case miller_t::M2:
+      cycles = 2;
+      break;
+    case miller_t::M4:
+      cycles = 4;
+      break;
+    case miller_t::M8:
+      cycles = 8;
+      break;
+  }
+  n_halves = 2 * cycles;
+  n_half_samples = static_cast<size_t>(samp_rate / (2 * blf));
+  fx_half = static_cast<uint64_t>(std::llround(std::ldexp(samp_rate / (2 * blf), 32)));
+  if (n_half_samples == 0) {
+    throw std::invalid_argument("Sample rate is too low for the requested BLF.");
+  }
+
+  if (m == miller_t::M1) {
+    if (trext) {
+      // Twelve data-0 symbols, ending low so the preamble starts high.
+      for (int i = 0; i < 12; ++i) {
+        preamble_halves.push_back(1);
+        preamble_halves.push_back(0);
+      }
+    }
+    preamble_halves.insert(preamble_halves.end(), std::begin(fm0_preamble), std::end(fm0_preamble));
+    after_preamble = {1, 1};
+  } else {
+    State state = {1, 1};
+    std::vector<int> bits(trext ? 16 : 4, 0);
+    bits.insert(bits.end(), {0, 1, 0, 1, 1, 1});
+    std::vector<uint8_t> halves(n_halves);
+    for (int bit : bits) {
+      symbol_halves(symbol_start(bit, state), bit, halves.data());
+      preamble_halves.insert(preamble_halves.end(), halves.begin(), halves.end());
+    }
+    after_preamble = state;
+  }
+
+  for (auto level : preamble_halves) {
+    preamble.append(level, n_half_samples);
+  }
+  std::vector<uint8_t> halves(n_halves);
+  for (uint8_t start = 0; start < 2; ++start) {
+    for (int bit = 0; bit < 2; ++bit) {
+      symbol_halves(start, bit, halves.data());
+      for (auto level : halves) {
+        symbols[2 * start + bit].append(level, n_half_samples);
+      }
+    }
+  }
+}
+
+// Baseband level of the first half of the next symbol.
+uint8_t TagEncoder::symbol_start(int bit, State& state) const {
+  uint8_t start;
+  if (m == miller_t::M1) {
+    // FM0 inverts at every symbol boundary and mid-symbol for data-0.
+    start = !state.level;
+    state.level = bit ? start : !start;
+  } else {
+    // Miller inverts mid-symbol for data-1 and between two data-0s.
+    if (!bit && !state.prev_bit) {
+      state.level = !state.level;
+    }
+    start = state.level;
+    if (bit) {
+      state.level = !state.level;
+    }
+  }
+  state.prev_bit = bit;
+  return start;
+}
+
+void TagEncoder::symbol_halves(uint8_t start, int bit, uint8_t* out) const {
+  if (m == miller_t::M1) {
+    out[0] = start;
+    out[1] = bit ? start : !start;
+    return;
+  }
+  // Miller: baseband times a square subcarrier of M cycles per symbol.
+  uint8_t end = bit ? !start : start;
+  size_t half_symbol = n_halves / 2;
+  for (size_t k = 0; k < n_halves; ++k) {
+    uint8_t baseband = k < half_symbol ? start : end;
+    uint8_t subcarrier = k % 2 == 0;
+    out[k] = baseband ? subcarrier : !subcarrier;
+  }
+}
+
+void TagEncoder::emit_halves(WaveSink& sink, const uint8_t* halves, size_t n, pie_phase_t& phase) const {
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t total = phase + fx_half;
+    phase = static_cast<pie_phase_t>(total);
+    sink.fill(halves[i], total >> 32);
+  }
+}
+
+void TagEncoder::reply(WaveSink& sink, const BitBuffer& data) const {
+  State state = after_preamble;
+  if (timing_mode == timing_t::TRUNCATE) {
+    preamble.expand_to(sink);
+    for (size_t i = 0; i <= data.size(); ++i) {
+      int bit = i < data.size() ? data[i] : 1;
+      auto& symbol = symbols[2 * symbol_start(bit, state) + bit].runs();
+      sink.write_runs(symbol.data(), symbol.size());
+    }
+    return;
+  }
+
+  pie_phase_t phase = pie_phase_start;
+  emit_halves(sink, preamble_halves.data(), preamble_halves.size(), phase);
+  uint8_t halves[16];
+  for (size_t i = 0; i <= data.size(); ++i) {
+    int bit = i < data.size() ? data[i] : 1;
+    symbol_halves(symbol_start(bit, state), bit, halves);
+    emit_halves(sink, halves, n_halves, phase);
+  }
+}
+
+void TagEncoder::epc_reply(WaveSink& sink, const BitBuffer& pc_epc) const {
+  BitBuffer bits = pc_epc;
+  bits.append(crc16(pc_epc), 16);
+  reply(sink, bits);
+}
+
+size_t TagEncoder::reply_length(size_t n_bits) const {
+  size_t halves = preamble_halves.size() + (n_bits + 1) * n_halves;
+  if (timing_mode == timing_t::EXACT) {
+    return (pie_phase_start + halves * fx_half) >> 32;
+  }
+  return halves * n_half_samples;
+}
+
+template <typename T>
+std::vector<T> TagEncoder::reply(const BitBuffer& data) const {
+  std::vector<T> wave;
+  wave.reserve(reply_length(data.size()));
+  VectorSink<T> sink(wave);
+  reply(sink, data);
+  return wave;
+}
+
+template std::vector<uint8_t> TagEncoder::reply<uint8_t>(const BitBuffer&) const;
+template std::vector<int16_t> TagEncoder::reply<int16_t>(const BitBuffer&) const;
+template std::vector<float> TagEncoder::reply<float>(const BitBuffer&) const;
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bits.hpp"
+#include "reader.hpp"
+#include "rle.hpp"
+#include "sink.hpp"
+
+// Tag-to-reader backscatter encoder: FM0 (miller_t::M1) or Miller M2/M4/M8
+// subcarrier, at the BLF announced by the Query. Levels are the two
+// backscatter states. A reply is the preamble (led by the pilot tone when
+// TRext is set), the data bits and the trailing dummy 1.
+//
+// Every symbol is one of four patterns, fixed by its bit and the baseband
+// level it starts with, so in TRUNCATE timing each symbol is a copy of a
+// precomputed run template, as on the reader side. EXACT timing places
+// every half subcarrier cycle with the phase accumulator instead.
+class TagEncoder {
+ public:
+  TagEncoder(int samp_rate, double blf, miller_t m = miller_t::M1, bool trext = false,
+             timing_t timing = timing_t::TRUNCATE);
+
+  // Reply carrying data, e.g. an RN16.
+  void reply(WaveSink& sink, const BitBuffer& data) const;
+  // Reply to an Ack: PC + EPC followed by their CRC-16.
+  void epc_reply(WaveSink& sink, const BitBuffer& pc_epc) const;
+  // Number of samples reply() produces for n_bits data bits.
+  size_t reply_length(size_t n_bits) const;
+
+  int sample_rate() const { return samp_rate; }
+  double link_frequency() const { return blf; }
+  miller_t miller() const { return m; }
+  bool pilot() const { return trext; }
+  // Levels of the preamble half subcarrier cycles, pilot first, and the
+  // number of half cycles per symbol; receivers build templates from them.
+  const std::vector<uint8_t>& preamble_levels() const { return preamble_halves; }
+  size_t halves_per_symbol() const { return n_halves; }
+
+  template <typename T = sample_t>
+  std::vector<T> reply(const BitBuffer& data) const;
+
+ private:
+  // Level after the last half cycle (FM0) or baseband level (Miller), and
+  // the previous data bit.
+  struct State {
+    uint8_t level;
+    uint8_t prev_bit;
+  };
+
+  uint8_t symbol_start(int bit, State& state) const;
+  void symbol_halves(uint8_t start, int bit, uint8_t* out) const;
+  void emit_halves(WaveSink& sink, const uint8_t* halves, size_t n, pie_phase_t& phase) const;
+
+  int samp_rate;
+  double blf;
+  miller_t m;
+  bool trext;
+  timing_t timing_mode;
+  // Half subcarrier cycles per symbol: 2 for FM0, 2 * M for Miller.
+  size_t n_halves;
+  size_t n_half_samples;
+  uint64_t fx_half;
+
+  std::vector<uint8_t> preamble_halves;
+  State after_preamble;
+  RleWave preamble;
+  // Indexed by 2 * start + bit.
+  RleWave symbols[4];
+};
@@ -0,0 +1,421 @@
+#include "tag_decoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+#include "crc/crc.hpp"
+#include "io.hpp"
+#include "tag.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EPCPHY_X86 1
+#include <immintrin.h>
+#endif
+
+// Candidate offsets per block of the preamble search.
+static constexpr size_t block_size = 4096;
+// Preamble symbols after the pilot: FM0 1 0 1 0 v 1, Miller 0 1 0 1 1 1.
+static constexpr size_t preamble_symbols = 6;
+// Fine link frequency steps per coarse step when refining a detection.
+static constexpr int fine_steps = 8;
+
+// acc[i] += w * s[i]: one template tap applied to a block of offsets.
+static void axpy_scalar(float w, const float* s, float* acc, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    acc[i] += w * s[i];
+  }
+}
+
+#ifdef EPCPHY_X86
+
+__attribute__((target("sse2"))) static void axpy_sse2(float w, const float* s, float* acc, size_t n) {
+  const __m128 vw = _mm_set1_ps(w);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 a = _mm_loadu_ps(acc + i);
+    _mm_storeu_ps(acc + i, _mm_add_ps(a, _mm_mul_ps(vw, _mm_loadu_ps(s + i))));
+  }
+  axpy_scalar(w, s + i, acc + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void axpy_avx2(float w, const float* s, float* acc, size_t n) {
+  const __m256 vw = _mm256_set1_ps(w);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256 a0 = _mm256_loadu_ps(acc + i);
+    __m256 a1 = _mm256_loadu_ps(acc + i + 8);
+    _mm256_storeu_ps(acc + i, _mm256_add_ps(a0, _mm256_mul_ps(vw, _mm256_loadu_ps(s + i))));
+    _mm256_storeu_ps(acc + i + 8, _mm256_add_ps(a1, _mm256_mul_ps(vw, _mm256_loadu_ps(s + i + 8))));
+  }
+  axpy_sse2(w, s + i, acc + i, n - i);
+}
+
+static bool has_avx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+
+#endif
+
+static void axpy(float w, const float* s, float* acc, size_t n) {
+#ifdef EPCPHY_X86
+  if (has_avx2()) {
+    axpy_avx2(w, s, acc, n);
+  } else {
+    axpy_sse2(w, s, acc, n);
+  }
+#else
+  axpy_scalar(w, s, acc, n);
+#endif
+}
+
+TagDecoder::TagDecoder(double samp_rate, double blf, miller_t m, bool trext, reply_t reply, double blf_tolerance,
+                       float threshold)
+    : samp_rate(samp_rate), reply(reply), threshold(threshold) {
+  if (blf <= 0 || samp_rate <= 0) {
+    throw std::invalid_argument("Sample rate and BLF must be positive.");
+  }
+  if (reply == reply_t::NONE) {
+    throw std::invalid_argument("Reply type must be RN16 or EPC.");
+  }
+  if (blf_tolerance < 0 || blf_tolerance >= 0.5) {
+    throw std::invalid_argument("BLF tolerance must be in 0..0.5.");
+  }
+  half = samp_rate / (2 * blf);
+  if (half < 2) {
+    throw std::invalid_argument("Sample rate is too low for the requested BLF.");
+  }
+
+  TagEncoder encoder(static_cast<int>(std::lround(samp_rate)), blf, m, trext);
+  auto& levels = encoder.preamble_levels();
+  n_halves = encoder.halves_per_symbol();
+  size_t n_pattern = preamble_symbols * n_halves;
+  pilot_halves = levels.size() - n_pattern;
+  for (size_t k = pilot_halves; k < levels.size(); ++k) {
+    pattern.push_back(levels[k] ? 1.0f : -1.0f);
+  }
+
+  // Coarse steps keep the template within about half a half cycle of the
+  // signal at its ends.
+  int n_side = static_cast<int>(std::ceil(blf_tolerance * n_pattern));
+  for (int k = -n_side; k <= n_side; ++k) {
+    candidates.push_back(half * (1 + (n_side ? blf_tolerance * k / n_side : 0)));
+  }
+  fine_step = n_side ? half * blf_tolerance / n_side / fine_steps : half / n_pattern / fine_steps;
+}
+
+// Prefix sums of a span of samples, so that a preamble correlation anywhere
+// in it costs one term per template half cycle.
+struct PrefixSums {
+  size_t origin;
+  std::vector<std::complex<double>> sum;
+
+  PrefixSums(const std::complex<float>* x, size_t begin, size_t end) : origin(begin), sum(end - begin + 1) {
+    for (size_t i = begin; i < end; ++i) {
+      sum[i - begin + 1] = sum[i - begin] + std::complex<double>(x[i]);
+    }
+  }
+};
+
+struct PreambleMatch {
+  float quality = -1;
+  size_t start = 0;
+  double half = 0;
+  std::complex<double> corr;
+  std::complex<double> mean;
+};
+
+// Correlation of the preamble template at start, normalized by the spread
+// of the half cycle means rather than of the samples, so that noise that
+// averages out over a half cycle does not lower the quality of a match.
+static PreambleMatch match_preamble(const PrefixSums& prefix, const std::vector<float>& pattern, size_t start,
+                                    double half) {
+  size_t base = start - prefix.origin;
+  size_t len = static_cast<size_t>(std::llround(pattern.size() * half));
+
+  PreambleMatch m;
+  m.start = start;
+  m.half = half;
+  m.mean = (prefix.sum[base + len] - prefix.sum[base]) / static_cast<double>(len);
+  double spread = 0;
+  size_t b0 = 0;
+  for (size_t k = 0; k < pattern.size(); ++k) {
+    size_t b1 = static_cast<size_t>(std::llround((k + 1) * half));
+    double n = static_cast<double>(b1 - b0);
+    auto part = prefix.sum[base + b1] - prefix.sum[base + b0] - n * m.mean;
+    m.corr += static_cast<double>(pattern[k]) * part;
+    spread += std::norm(part) / n;
+    b0 = b1;
+  }
+  m.quality = spread > 0 ? static_cast<float>(std::norm(m.corr) / (len * spread)) : 0.0f;
+  return m;
+}
+
+void TagDecoder::scan(const std::complex<float>* samples, size_t n, const Handler& handler, uint64_t base) const {
+  // The block search runs on prefix sums taken every `step` samples, which
+  // moves template edges by at most step / 2 (a sixteenth of a half cycle);
+  // decode_at() searches again at full resolution.
+  size_t step = std::max<size_t>(1, static_cast<size_t>(half / 8));
+  // Steps covered by the longest candidate template.
+  size_t span = static_cast<size_t>(std::ceil(pattern.size() * candidates.back() / step)) + 1;
+  if (n < (span + 1) * step) {
+    return;
+  }
+  size_t window = block_size + span;
+  std::vector<float> sum_i(window + 1), sum_q(window + 1), energy(window + 1);
+  std::vector<float> corr_i(block_size), corr_q(block_size), best(block_size);
+
+  // Template taps: weight p[k-1] - p[k] at every half cycle boundary k.
+  struct Tap {
+    size_t offset;
+    float weight;
+  };
+  std::vector<std::vector<Tap>> taps(candidates.size());
+  std::vector<size_t> lengths(candidates.size());
+  std::vector<float> imbalance(candidates.size());
+  for (size_t c = 0; c < candidates.size(); ++c) {
+    double h = candidates[c] / step;
+    for (size_t k = 0; k <= pattern.size(); ++k) {
+      float w = (k > 0 ? pattern[k - 1] : 0.0f) - (k < pattern.size() ? pattern[k] : 0.0f);
+      size_t at = static_cast<size_t>(std::llround(k * h));
+      if (w != 0) {
+        taps[c].push_back({at, w});
+      }
+      if (k > 0) {
+        size_t prev = static_cast<size_t>(std::llround((k - 1) * h));
+        imbalance[c] += pattern[k - 1] * (at - prev);
+      }
+    }
+    lengths[c] = static_cast<size_t>(std::llround(pattern.size() * h));
+  }
+
+  // The block search normalizes by the sample variance, which noise lowers
+  // more than the refined quality; it also may miss the peak on the coarse
+  // link frequency grid. Detections have to reach the threshold once refined.
+  float detect = 0.4f * threshold;
+  size_t resume = 0;
+  for (size_t b = 0; b + (span + 1) * step <= n;) {
+    size_t m = std::min(block_size, (n - b) / step - span);
+    if (resume >= b + m * step) {
+      b = resume;
+      continue;
+    }
+
+    // Prefix sums of the window around its mean, which keeps float sums
+    // small next to the modulation.
+    size_t w = (m + span) * step;
+    std::complex<double> mean = 0;
+    for (size_t i = 0; i < w; ++i) {
+      mean += std::complex<double>(samples[b + i]);
+    }
+    mean /= static_cast<double>(w);
+    double si = 0, sq = 0, se = 0;
+    for (size_t j = 0; j < m + span; ++j) {
+      for (size_t i = j * step; i < (j + 1) * step; ++i) {
+        double re = samples[b + i].real() - mean.real();
+        double im = samples[b + i].imag() - mean.imag();
+        si += re;
+        sq += im;
+        se += re * re + im * im;
+      }
+      sum_i[j + 1] = static_cast<float>(si);
+      sum_q[j + 1] = static_cast<float>(sq);
+      energy[j + 1] = static_cast<float>(se);
+    }
+
+    std::fill_n(best.begin(), m, 0.0f);
+    for (size_t c = 0; c < candidates.size(); ++c) {
+      std::fill_n(corr_i.begin(), m, 0.0f);
+      std::fill_n(corr_q.begin(), m, 0.0f);
+      for (auto& tap : taps[c]) {
+        axpy(tap.weight, sum_i.data() + tap.offset, corr_i.data(), m);
+        axpy(tap.weight, sum_q.data() + tap.offset, corr_q.data(), m);
+      }
+      // Remove the local mean seen through the rounding imbalance of the
+      // template, then normalize by the local variance.
+      size_t len = lengths[c];
+      float leak = imbalance[c] / len;
+      float inv_samples = 1.0f / (len * step);
+      const float* si0 = sum_i.data();
+      const float* sq0 = sum_q.data();
+      const float* se0 = energy.data();
+      for (size_t i = 0; i < m; ++i) {
+        float local_i = si0[i + len] - si0[i];
+        float local_q = sq0[i + len] - sq0[i];
+        float ci = corr_i[i] - leak * local_i;
+        float cq = corr_q[i] - leak * local_q;
+        float var = (se0[i + len] - se0[i]) - (local_i * local_i + local_q * local_q) * inv_samples;
+        float quality = (ci * ci + cq * cq) * inv_samples / (var + 1e-30f);
+        best[i] = std::max(best[i], quality);
+      }
+    }
+
+    size_t i = resume > b ? (resume - b + step - 1) / step : 0;
+    for (; i < m; ++i) {
+      if (best[i] > detect) {
+        resume = decode_at(samples, n, b + i * step, handler, base);
+        if (resume >= b + m * step) {
+          break;
+        }
+        i = (resume - b + step - 1) / step - 1;
+      }
+    }
+    b += m * step;
+  }
+}
+
+size_t TagDecoder::decode_at(const std::complex<float>* x, size_t n, size_t start, const Handler& handler,
+                             uint64_t base) const {
+  // Refine over one symbol of offsets and every candidate link frequency,
+  // then in finer link frequency steps around the best.
+  size_t span = static_cast<size_t>(std::ceil(pattern.size() * (candidates.back() + fine_steps * fine_step))) + 1;
+  size_t begin = start - std::min(start, static_cast<size_t>(n_halves * half / 2));
+  size_t last = std::min(start + static_cast<size_t>(n_halves * half), n - std::min(n, span));
+  if (last <= begin) {
+    return start + 1;
+  }
+  PrefixSums prefix(x, begin, last + span);
+
+  PreambleMatch best;
+  for (double h : candidates) {
+    for (size_t g = begin; g < last; ++g) {
+      auto m = match_preamble(prefix, pattern, g, h);
+      if (m.quality > best.quality) {
+        best = m;
+      }
+    }
+  }
+  double coarse = best.half;
+  for (int f = -fine_steps / 2; f <= fine_steps / 2; ++f) {
+    double h = coarse + f * fine_step;
+    for (size_t g = begin; g < last; ++g) {
+      auto m = match_preamble(prefix, pattern, g, h);
+      if (m.quality > best.quality) {
+        best = m;
+      }
+    }
+  }
+  if (best.quality < threshold) {
+    // Every offset up to last has been tried.
+    return std::max(last, start + 1);
+  }
+
+  // Project on the modulation axis found by the correlation; positive is
+  // level 1 of the template.
+  double h = best.half;
+  double symbol = n_halves * h;
+  std::complex<double> axis = std::conj(best.corr) / std::abs(best.corr);
+  auto half_sum = [&](double from, size_t k) {
+    size_t b0 = static_cast<size_t>(std::llround(from + k * h));
+    size_t b1 = static_cast<size_t>(std::llround(from + (k + 1) * h));
+    std::complex<double> sum = 0;
+    for (size_t i = b0; i < b1; ++i) {
+      sum += std::complex<double>(x[i]);
+    }
+    return ((sum - static_cast<double>(b1 - b0) * best.mean) * axis).real();
+  };
+  // Correlations with the first and second half of the symbol; Miller
+  // halves are multiplied by the subcarrier.
+  bool fm0 = n_halves == 2;
+  auto decide = [&](double from, int& bit) {
+    double a = 0, b = 0;
+    for (size_t k = 0; k < n_halves; ++k) {
+      double v = half_sum(from, k);
+      if (!fm0 && k % 2) {
+        v = -v;
+      }
+      (k < n_halves / 2 ? a : b) += v;
+    }
+    double same = std::abs(a + b);
+    double flip = std::abs(a - b);
+    bit = fm0 ? same > flip : flip > same;
+    return std::max(same, flip);
+  };
+
+  double delta = std::max(1.0, std::floor(h / 8));
+  double t = best.start + pattern.size() * h;
+  size_t preamble_end = static_cast<size_t>(std::llround(t));
+  BitBuffer bits;
+  size_t n_bits = 16;
+  while (bits.size() < n_bits) {
+    if (t + symbol + 2 * delta + 1 >= n) {
+      return preamble_end;
+    }
+    int bit = 0, early_bit = 0, late_bit = 0;
+    double on_time = decide(t, bit);
+    double early = decide(t - delta, early_bit);
+    double late = decide(t + delta, late_bit);
+    if (early > on_time && early >= late) {
+      t -= delta;
+      bit = early_bit;
+    } else if (late > on_time) {
+      t += delta;
+      bit = late_bit;
+    }
+    bits.push_back(bit);
+    t += symbol;
+    if (reply == reply_t::EPC && bits.size() == 16) {
+      // PC: EPC length in words in its first five bits, then the CRC-16.
+      size_t words = 0;
+      for (size_t i = 0; i < 5; ++i) {
+        words = words << 1 | bits[i];
+      }
+      n_bits = 16 + 16 * words + 16;
+    }
+  }
+  // Dummy 1.
+  t += symbol;
+
+  DecodedReply decoded;
+  double offset = std::max(0.0, best.start - pilot_halves * h);
+  decoded.offset = base + static_cast<uint64_t>(std::llround(offset));
+  decoded.length = static_cast<uint64_t>(std::llround(t - offset));
+  decoded.blf = samp_rate / (2 * h);
+  decoded.quality = best.quality;
+  decoded.crc = crc_status_t::NONE;
+  if (reply == reply_t::EPC) {
+    size_t n_data = bits.size() - 16;
+    uint16_t received = 0;
+    for (size_t i = n_data; i < bits.size(); ++i) {
+      received = received << 1 | bits[i];
+    }
+    decoded.crc = crc16(bits.data(), 0, n_data) == received ? crc_status_t::OK : crc_status_t::BAD;
+  }
+  decoded.bits = std::move(bits);
+  handler(decoded);
+  if (decoded.crc == crc_status_t::BAD) {
+    // A misread PC length may span the next reply; search on after the
+    // preamble instead.
+    return preamble_end;
+  }
+  return static_cast<size_t>(std::llround(t));
+}
+
+void decode_replies_file(const std::string& path, const TagDecoder& decoder, const TagDecoder::Handler& handler) {
+  MappedFile file(path);
+  if (file.size() % sizeof(std::complex<float>) != 0) {
+    throw std::runtime_error("Input is not a whole number of cf32 samples: " + path);
+  }
+  decoder.scan(reinterpret_cast<const std::complex<float>*>(file.data()), file.size() / sizeof(std::complex<float>),
+               handler);
+}
+
+std::string format_reply(const DecodedReply& reply) {
+  static const char* crc_names[] = {"none", "ok", "bad"};
+  char head[160];
+  std::snprintf(head, sizeof(head), "offset=%llu length=%llu blf=%.0f quality=%.2f crc=%s ",
+                static_cast<unsigned long long>(reply.offset), static_cast<unsigned long long>(reply.length),
+                reply.blf, reply.quality, crc_names[static_cast<int>(reply.crc)]);
+  std::string line = head;
+  if (reply.crc == crc_status_t::NONE) {
+    line += "rn16=" + bits_to_bin(reply.bits);
+  } else {
+    // PC + EPC as taken by the reply spec, which appends the CRC itself.
+    BitBuffer pc_epc = reply.bits;
+    pc_epc.truncate(pc_epc.size() - 16);
+    line += "epc=" + bits_to_hex(pc_epc);
+  }
+  return line;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "bits.hpp"
+#include "decoder.hpp"
+#include "reader.hpp"
+#include "sequencer.hpp"
+
+// A tag reply recovered from a capture.
+struct DecodedReply {
+  // Sample index of the first half cycle (pilot included) and samples up to
+  // the end of the dummy 1.
+  uint64_t offset;
+  uint64_t length;
+  // Link frequency measured on the preamble.
+  double blf;
+  // Normalized preamble correlation, 0..1.
+  float quality;
+  // RN16, or PC + EPC + CRC-16.
+  BitBuffer bits;
+  crc_status_t crc;
+};
+
+// Receiver for FM0 / Miller tag backscatter in complex baseband captures,
+// the counterpart of TagEncoder.
+//
+// The preamble is found with a matched filter built on prefix sums of the
+// samples: its template is piecewise constant over half subcarrier cycles,
+// so the correlation at an offset is a short weighted sum of prefix sums at
+// the template's level changes. Each weight is applied to a whole block of
+// candidate offsets at once with SIMD multiply-adds, for every candidate
+// link frequency within the tolerance, and the block is normalized by the
+// local variance without branches; only offsets above the threshold are
+// looked at again. A detection is refined in offset and link frequency,
+// the modulation axis and DC level are taken from the preamble, and every
+// symbol is decided from the correlations of its two halves, which needs no
+// knowledge of the starting level. An early/late search per symbol tracks
+// the tag clock. EPC replies are checked against their CRC-16.
+class TagDecoder {
+ public:
+  using Handler = std::function<void(const DecodedReply&)>;
+
+  TagDecoder(double samp_rate, double blf, miller_t m = miller_t::M1, bool trext = false,
+             reply_t reply = reply_t::RN16, double blf_tolerance = 0.05, float threshold = 0.8f);
+
+  // Decode every reply in samples; offsets are reported relative to base.
+  void scan(const std::complex<float>* samples, size_t n, const Handler& handler, uint64_t base = 0) const;
+
+ private:
+  // Decode the reply whose preamble was detected near start; returns the
+  // sample to resume the search from.
+  size_t decode_at(const std::complex<float>* x, size_t n, size_t start, const Handler& handler, uint64_t base) const;
+
+  double samp_rate;
+  double half;
+  reply_t reply;
+  float threshold;
+  size_t n_halves;
+  size_t pilot_halves;
+  // Preamble template after the pilot: +1 / -1 per half cycle.
+  std::vector<float> pattern;
+  // Half cycle lengths of the block search, nominal and within tolerance.
+  std::vector<double> candidates;
+  double fine_step;
+};
+
+void decode_replies_file(const std::string& path, const TagDecoder& decoder, const TagDecoder::Handler& handler);
+
+// One log line: sample offset and length, measured BLF, preamble quality,
+// CRC status and the reply data.
+std::string format_reply(const DecodedReply& reply);
@@ -0,0 +1,134 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+#include "reader.hpp"
+
+// Pool and queue index of the worker running on this thread, if any.
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+ThreadPool::ThreadPool(size_t n_threads) {
+  if (n_threads == 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < n_threads; ++i) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+  threads.reserve(n_threads);
+  for (size_t i = 0; i < n_threads; ++i) {
+    threads.emplace_back(&ThreadPool::worker_loop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::push(Task task) {
+  size_t index = current_pool == this ? current_index : next_queue++ % queues.size();
+  {
+    // Counted under wake_mutex so a worker checking for work cannot miss it,
+    // and before the task is visible so a thief's decrement cannot run first
+    // and wrap the count.
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    ++pending;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queues[index]->mutex);
+    queues[index]->tasks.push_back(std::move(task));
+  }
+  wake.notify_one();
+}
+
+bool ThreadPool::pop(size_t index, Task& task) {
+  {
+    auto& own = *queues[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      --pending;
+      return true;
+    }
+  }
+  for (size_t k = 1; k < queues.size(); ++k) {
+    auto& victim = *queues[(index + k) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --pending;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+  current_pool = this;
+  current_index = index;
+  // Scratch memory for the commands of every task run on this worker.
+  CommandArena arena;
+  while (true) {
+    Task task;
+    if (pop(index, task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    wake.wait(lock, [this]() { return stopping || pending > 0; });
+    if (stopping && pending == 0) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)>& body) {
+  if (n == 0) {
+    return;
+  }
+  // The calling thread drains too; give it an arena for this call only.
+  CommandArena arena;
+  // Indices are claimed one at a time from a shared counter, which balances
+  // by itself; the tasks only provide the threads to claim them.
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto drain = [&]() {
+    for (size_t i = next++; i < n && !failed; i = next++) {
+      try {
+        body(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed = true;
+      }
+    }
+  };
+
+  std::vector<std::future<void>> helpers;
+  size_t n_helpers = std::min(size(), n - 1);
+  helpers.reserve(n_helpers);
+  for (size_t i = 0; i < n_helpers; ++i) {
+    helpers.push_back(submit(drain));
+  }
+  drain();
+  for (auto& helper : helpers) {
+    helper.wait();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed-size pool with one task deque per worker. A worker takes its newest
+// task from the back of its own deque and, when that is empty, steals the
+// oldest task from the front of another worker's deque, so uneven batches
+// (a long Select next to many short QueryReps) still keep every core busy.
+// Tasks submitted from outside the pool are dealt round-robin; tasks
+// submitted from inside a worker go to that worker's own deque. Each worker
+// keeps a CommandArena for its lifetime, so tasks encode commands without
+// heap allocations.
+class ThreadPool {
+ public:
+  // n_threads == 0 uses one worker per hardware thread.
+  explicit ThreadPool(size_t n_threads = 0);
+  // Runs all queued tasks, then joins the workers.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t size() const { return threads.size(); }
+
+  // Queue f and return a future for its result; exceptions thrown by f are
+  // rethrown from future::get().
+  template <typename F>
+  std::future<std::invoke_result_t<F>> submit(F&& f) {
+    using R = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto result = task->get_future();
+    push([task]() { (*task)(); });
+    return result;
+  }
+
+  // Call body(i) for every i in [0, n), spread over the workers and the
+  // calling thread. Blocks until all calls returned and rethrows the first
+  // exception. Must not be called from a task running on this pool.
+  void parallel_for(size_t n, const std::function<void(size_t)>& body);
+
+ private:
+  using Task = std::function<void()>;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void push(Task task);
+  bool pop(size_t index, Task& task);
+  void worker_loop(size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+  std::atomic<size_t> next_queue{0};
+
+  std::mutex wake_mutex;
+  std::condition_variable wake;
+  std::atomic<size_t> pending{0};
+  bool stopping = false;
+};
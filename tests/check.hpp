@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+// Minimal self-registering checks for epcphy_tests. TEST(name) defines a
+// case; CHECK throws on failure with the location and expression, and the
+// runner reports every failing case.
+using TestFunction = void (*)();
+
+void register_test(const char* name, TestFunction function);
+
+struct TestRegistration {
+  TestRegistration(const char* name, TestFunction function) { register_test(name, function); }
+};
+
+#define TEST(name)                                                         \
+  static void test_##name();                                               \
+  static const TestRegistration registration_##name(#name, test_##name);   \
+  static void test_##name()
+
+#define CHECK(condition)                                                                                  \
+  do {                                                                                                    \
+    if (!(condition)) {                                                                                   \
+      throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " #condition); \
+    }                                                                                                     \
+  } while (0)
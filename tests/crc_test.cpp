@@ -0,0 +1,41 @@
+#include <random>
+#include <string>
+
+#include "check.hpp"
+#include "crc/crc.hpp"
+
+TEST(crc_check_values) {
+  BitBuffer bits;
+  for (char c : std::string("123456789")) {
+    bits.append(static_cast<uint8_t>(c), 8);
+  }
+  CHECK(crc5(bits) == 0x00);
+  CHECK(crc16(bits) == 0xd64e);
+}
+
+// Checksumming any slice of a buffer, in place or in two pieces, must match
+// the CRC of a copy of just that slice.
+TEST(crc_bit_offset_matches_copy) {
+  std::mt19937_64 rng(2);
+  for (int trial = 0; trial < 500; ++trial) {
+    BitBuffer bits;
+    size_t n_bits = rng() % 300;
+    for (size_t i = 0; i < n_bits; ++i) {
+      bits.push_back(rng() & 1);
+    }
+    size_t offset = n_bits ? rng() % n_bits : 0;
+    size_t length = rng() % (n_bits - offset + 1);
+    BitBuffer slice;
+    for (size_t i = offset; i < offset + length; ++i) {
+      slice.push_back(bits[i]);
+    }
+    CHECK(crc5(bits.data(), offset, length) == crc5(slice));
+    CHECK(crc16(bits.data(), offset, length) == crc16(slice));
+
+    size_t split = rng() % (length + 1);
+    uint8_t head5 = crc5(bits.data(), offset, split);
+    uint16_t head16 = crc16(bits.data(), offset, split);
+    CHECK(crc5(bits.data(), offset + split, length - split, head5) == crc5(slice));
+    CHECK(crc16(bits.data(), offset + split, length - split, head16) == crc16(slice));
+  }
+}
@@ -0,0 +1,65 @@
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "decoder.hpp"
+#include "io.hpp"
+
+static const char* const round_specs[] = {
+    "select,pointer=32,mask=E2801160,target=SL,action=1,membank=EPC",
+    "query,dr=64/3,m=4,trext=1,sel=SL,session=S2,target=B,q=7",
+    "queryrep,session=S1",
+    "queryadjust,session=S3,updn=-1",
+    "ack,rn16=1010110011110000",
+    "select,pointer=200,mask=ABC,trunc=1,target=INV_S2,action=5,membank=TID",
+};
+
+// Generate every command of round_specs between stretches of carrier, decode
+// the capture and expect the same commands back with good CRCs.
+static void round_trip(int samp_rate, timing_t timing, Modulation modulation) {
+  auto path = (std::filesystem::temp_directory_path() / "epcphy_tests_decoder.cf32").string();
+  RFIDReaderCommand reader(std::make_shared<const PulseIntervalEncoder>(samp_rate, 12, timing));
+  std::vector<std::string> expected;
+  {
+    FileSink sink(path, iq_format_t::CF32, modulation);
+    sink.fill(1, samp_rate / 2500);
+    for (auto text : round_specs) {
+      auto spec = parse_command_spec(text, false);
+      generate_command(reader, spec, sink);
+      sink.fill(1, samp_rate / 2500);
+      expected.push_back(format_command_spec(spec));
+    }
+    sink.close();
+  }
+
+  std::vector<std::string> decoded;
+  decode_file(path, samp_rate, [&](const DecodedCommand& command) {
+    CHECK(command.spec && command.crc != crc_status_t::BAD);
+    decoded.push_back(format_command_spec(*command.spec));
+  });
+  std::filesystem::remove(path);
+  CHECK(decoded == expected);
+}
+
+TEST(decoder_round_trip_dsb) {
+  for (int samp_rate : {800000, 1000000, 2000000, 3000000, 4000000}) {
+    round_trip(samp_rate, timing_t::TRUNCATE, {});
+    round_trip(samp_rate, timing_t::EXACT, {0.5f, 0.9f});
+  }
+}
+
+TEST(decoder_round_trip_ssb) {
+  for (int samp_rate : {800000, 1000000, 2000000, 3000000, 4000000}) {
+    round_trip(samp_rate, timing_t::TRUNCATE, {1.0f, 1.0f, modulation_t::SSB});
+    round_trip(samp_rate, timing_t::EXACT, {0.3f, 1.0f, modulation_t::SSB, 0.05});
+  }
+}
+
+TEST(decoder_round_trip_pr) {
+  for (int samp_rate : {1000000, 2000000}) {
+    round_trip(samp_rate, timing_t::TRUNCATE, {1.0f, 1.0f, modulation_t::PR});
+    round_trip(samp_rate, timing_t::TRUNCATE, {1.0f, 1.0f, modulation_t::PR, 0.1});
+  }
+}
@@ -0,0 +1,42 @@
+#include <exception>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "check.hpp"
+
+static std::map<std::string, TestFunction>& registry() {
+  static std::map<std::string, TestFunction> tests;
+  return tests;
+}
+
+void register_test(const char* name, TestFunction function) { registry()[name] = function; }
+
+// Runs every case whose name starts with one of the arguments, or all cases.
+int main(int argc, char* argv[]) {
+  int run = 0;
+  int failed = 0;
+  for (auto& [name, function] : registry()) {
+    bool selected = argc < 2;
+    for (int i = 1; i < argc; ++i) {
+      selected = selected || name.rfind(argv[i], 0) == 0;
+    }
+    if (!selected) {
+      continue;
+    }
+    ++run;
+    try {
+      function();
+      std::cout << "ok    " << name << std::endl;
+    } catch (const std::exception& e) {
+      ++failed;
+      std::cout << "FAIL  " << name << ": " << e.what() << std::endl;
+    }
+  }
+  if (run == 0) {
+    std::cerr << "No test matches." << std::endl;
+    return 1;
+  }
+  std::cout << run - failed << " of " << run << " passed" << std::endl;
+  return failed ? 1 : 0;
+}
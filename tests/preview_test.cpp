@@ -0,0 +1,61 @@
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "preview.hpp"
+
+// Span of dense[begin, end), the reference for LevelPyramid.
+static LevelSpan scan(const std::vector<uint8_t>& dense, uint64_t begin, uint64_t end) {
+  LevelSpan span;
+  for (uint64_t i = begin; i < end && i < dense.size(); ++i) {
+    span.merge({dense[i], dense[i]});
+  }
+  return span;
+}
+
+TEST(preview_span_matches_scan) {
+  std::mt19937_64 rng(1);
+  for (int trial = 0; trial < 200; ++trial) {
+    RleWave wave;
+    std::vector<uint8_t> dense;
+    int n_runs = rng() % 200;
+    for (int i = 0; i < n_runs; ++i) {
+      auto level = static_cast<uint8_t>(rng() % 3);
+      size_t length = rng() % 60;
+      wave.append(level, length);
+      dense.insert(dense.end(), length, level);
+    }
+    LevelPyramid pyramid(wave);
+    CHECK(pyramid.size() == dense.size());
+    for (int q = 0; q < 200; ++q) {
+      uint64_t a = rng() % (dense.size() + 5);
+      uint64_t b = rng() % (dense.size() + 5);
+      if (a > b) {
+        std::swap(a, b);
+      }
+      auto expected = scan(dense, a, b);
+      auto span = pyramid.span(a, b);
+      CHECK(span.lo == expected.lo && span.hi == expected.hi);
+    }
+  }
+}
+
+TEST(preview_columns_cover_view) {
+  RleWave wave;
+  for (int i = 0; i < 1000; ++i) {
+    wave.append(i & 1, 10);
+  }
+  LevelPyramid pyramid(wave);
+  std::vector<LevelSpan> columns;
+  // Zoomed in past one sample per column, every column is flat.
+  pyramid.columns(0, 20, 80, columns);
+  CHECK(columns.size() == 80);
+  for (size_t c = 0; c < columns.size(); ++c) {
+    CHECK(columns[c].lo == columns[c].hi && columns[c].lo == (c >= 40));
+  }
+  // Zoomed out, every column spans both levels.
+  pyramid.columns(0, 10000, 50, columns);
+  for (auto& span : columns) {
+    CHECK(span.lo == 0 && span.hi == 1);
+  }
+}
@@ -0,0 +1,24 @@
+#include <memory>
+
+#include "check.hpp"
+#include "reader.hpp"
+
+// Throwaway configurations must not grow the shared cache without bound,
+// and an entry in steady use must survive them.
+TEST(reader_template_cache_is_bounded) {
+  auto& cache = PieTemplateCache::shared();
+  cache.clear();
+  auto busy = cache.get(2000000, 12, 40000, 8);
+  for (int i = 0; i < 3 * static_cast<int>(PieTemplateCache::capacity); ++i) {
+    auto templates = cache.get(2000000, 12, 40000 + 100 * i, 8);
+    CHECK(cache.size() <= PieTemplateCache::capacity);
+    CHECK(cache.get(2000000, 12, 40000, 8) == busy);
+  }
+  // Evicted templates stay valid for whoever still holds them.
+  auto first = cache.get(1000000, 12, 40000, 64.0 / 3);
+  for (int i = 0; i < 2 * static_cast<int>(PieTemplateCache::capacity); ++i) {
+    cache.get(1000000, 12, 50000 + 100 * i, 8);
+  }
+  CHECK(first->preamble.size() > 0);
+  cache.clear();
+}
@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "select_batch.hpp"
+
+static BitBuffer random_mask(std::mt19937_64& rng, size_t n_bits) {
+  BitBuffer mask;
+  for (size_t i = 0; i < n_bits; ++i) {
+    mask.push_back(rng() & 1);
+  }
+  return mask;
+}
+
+// Masks with shared prefixes, long and short, in arbitrary order: every frame
+// must match a Select encoded from scratch.
+TEST(select_batch_matches_select) {
+  std::mt19937_64 rng(3);
+  for (auto timing : {timing_t::TRUNCATE, timing_t::EXACT}) {
+    for (int samp_rate : {800000, 2000000, 3000000}) {
+      auto pie = std::make_shared<const PulseIntervalEncoder>(samp_rate, 12, timing);
+      RFIDReaderCommand reader(pie);
+      SelectBatch batch(&reader, 32, true);
+      auto base = random_mask(rng, 96);
+      for (int i = 0; i < 40; ++i) {
+        BitBuffer mask;
+        size_t n_bits = rng() % 256;
+        size_t shared = std::min<size_t>(rng() % 97, n_bits);
+        for (size_t b = 0; b < shared; ++b) {
+          mask.push_back(base[b]);
+        }
+        auto tail = random_mask(rng, n_bits - shared);
+        for (size_t b = 0; b < tail.size(); ++b) {
+          mask.push_back(tail[b]);
+        }
+
+        std::vector<uint8_t> out;
+        VectorSink<uint8_t> sink(out);
+        batch.append(sink, mask);
+        CHECK(out == reader.select<uint8_t>(32, static_cast<uint8_t>(n_bits), mask, true));
+      }
+    }
+  }
+}
@@ -0,0 +1,79 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include "check.hpp"
+#include "shaper.hpp"
+
+static std::string read_file(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Streaming through ShapingSink in small blocks, with the levels arriving in
+// pieces, must give the envelope of shaping the whole waveform at once.
+TEST(shaper_blocks_match_whole_wave) {
+  std::mt19937_64 rng(4);
+  auto dir = std::filesystem::temp_directory_path();
+  auto whole_path = (dir / "epcphy_tests_whole.cf32").string();
+  auto streamed_path = (dir / "epcphy_tests_streamed.cf32").string();
+  for (auto shape : {edge_shape_t::LINEAR, edge_shape_t::RAISED_COSINE, edge_shape_t::GAUSSIAN}) {
+    PulseShaper shaper(2e6, 3e-6, shape);
+    RleWave wave;
+    for (int i = 0; i < 300; ++i) {
+      wave.append(static_cast<uint8_t>(rng() & 1), i % 50 == 0 ? 5000 : rng() % 20);
+    }
+
+    {
+      FileSink whole(whole_path, iq_format_t::CF32);
+      auto envelope = shaper.shape(wave);
+      whole.write_envelope(envelope.data(), envelope.size());
+      whole.close();
+    }
+    {
+      FileSink file(streamed_path, iq_format_t::CF32);
+      ShapingSink streamed(shaper, file, 64);
+      const auto& runs = wave.runs();
+      for (size_t i = 0; i < runs.size();) {
+        size_t n = std::min<size_t>(rng() % 8 + 1, runs.size() - i);
+        streamed.write_runs(runs.data() + i, n);
+        i += n;
+      }
+      streamed.finish();
+      file.close();
+    }
+    CHECK(read_file(whole_path) == read_file(streamed_path));
+  }
+  std::filesystem::remove(whole_path);
+  std::filesystem::remove(streamed_path);
+}
+
+#ifdef __linux__
+static long peak_rss_kb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// A long CW gap is a single run; shaping it must not buffer it whole
+// (50 M samples would be 200 MB of envelope).
+TEST(shaper_long_cw_memory_is_flat) {
+  PulseShaper shaper(2e6, 3e-6);
+  long before = peak_rss_kb();
+  FileSink file("/dev/null", iq_format_t::CU8);
+  ShapingSink shaped(shaper, file);
+  shaped.fill(0, 1000);
+  shaped.fill(1, 50000000);
+  shaped.fill(0, 1000);
+  shaped.finish();
+  file.close();
+  CHECK(peak_rss_kb() - before < 64 * 1024);
+}
+#endif
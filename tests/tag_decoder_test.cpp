@@ -0,0 +1,71 @@
+#include <complex>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "crc/crc.hpp"
+#include "tag.hpp"
+#include "tag_decoder.hpp"
+
+// Backscatter of levels on a carrier at an arbitrary phase, with noise.
+static void backscatter(const std::vector<uint8_t>& levels, std::mt19937_64& rng,
+                        std::vector<std::complex<float>>& out) {
+  std::normal_distribution<float> noise(0.0f, 0.02f);
+  std::complex<float> carrier = std::polar(0.8f, 1.1f);
+  std::complex<float> modulation = std::polar(0.2f, -0.4f);
+  for (auto level : levels) {
+    out.push_back(carrier + (level ? modulation : -modulation) + std::complex<float>(noise(rng), noise(rng)));
+  }
+}
+
+// Replies from TagEncoder, between stretches of carrier, decode back to
+// their data with a good CRC.
+TEST(tag_decoder_round_trip) {
+  std::mt19937_64 rng(7);
+  for (int samp_rate : {1000000, 4000000}) {
+    for (auto m : {miller_t::M1, miller_t::M2, miller_t::M4, miller_t::M8}) {
+      for (bool trext : {false, true}) {
+        for (auto reply : {reply_t::RN16, reply_t::EPC}) {
+          double blf = samp_rate / 25.0;
+          TagEncoder tag(samp_rate, blf, m, trext);
+          std::vector<BitBuffer> sent;
+          std::vector<std::complex<float>> samples;
+          backscatter(std::vector<uint8_t>(500, 0), rng, samples);
+          for (int i = 0; i < 3; ++i) {
+            // An EPC reply's length comes from its PC: 6 words of EPC.
+            BitBuffer data;
+            if (reply == reply_t::EPC) {
+              data.append(6, 5);
+              data.append(0, 11);
+            }
+            for (int b = 0; b < (reply == reply_t::RN16 ? 16 : 96); ++b) {
+              data.push_back(rng() & 1);
+            }
+            std::vector<uint8_t> levels;
+            VectorSink<uint8_t> sink(levels);
+            if (reply == reply_t::RN16) {
+              tag.reply(sink, data);
+            } else {
+              tag.epc_reply(sink, data);
+              data.append(crc16(data), 16);
+            }
+            backscatter(levels, rng, samples);
+            backscatter(std::vector<uint8_t>(700, 0), rng, samples);
+            sent.push_back(data);
+          }
+
+          std::vector<BitBuffer> received;
+          TagDecoder decoder(samp_rate, blf, m, trext, reply);
+          decoder.scan(samples.data(), samples.size(), [&](const DecodedReply& r) {
+            CHECK(r.crc != crc_status_t::BAD);
+            received.push_back(r.bits);
+          });
+          CHECK(received.size() == sent.size());
+          for (size_t i = 0; i < sent.size() && i < received.size(); ++i) {
+            CHECK(received[i] == sent[i]);
+          }
+        }
+      }
+    }
+  }
+}
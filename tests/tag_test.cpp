@@ -0,0 +1,46 @@
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "crc/crc.hpp"
+#include "tag.hpp"
+
+TEST(tag_encoder_reply_length) {
+  std::mt19937_64 rng(5);
+  for (auto timing : {timing_t::TRUNCATE, timing_t::EXACT}) {
+    for (int samp_rate : {1000000, 2000000, 3000000}) {
+      for (double blf : {40000.0, 160000.0, 320000.0}) {
+        for (auto m : {miller_t::M1, miller_t::M2, miller_t::M4, miller_t::M8}) {
+          for (bool trext : {false, true}) {
+            TagEncoder tag(samp_rate, blf, m, trext, timing);
+            for (size_t n_bits : {0, 1, 16, 17, 128}) {
+              BitBuffer data;
+              for (size_t i = 0; i < n_bits; ++i) {
+                data.push_back(rng() & 1);
+              }
+              CHECK(tag.reply<uint8_t>(data).size() == tag.reply_length(n_bits));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// epc_reply() is reply() of PC + EPC with their CRC-16 appended.
+TEST(tag_encoder_epc_reply_appends_crc) {
+  std::mt19937_64 rng(6);
+  TagEncoder tag(2000000, 160000, miller_t::M4, true);
+  BitBuffer pc_epc;
+  for (int i = 0; i < 112; ++i) {
+    pc_epc.push_back(rng() & 1);
+  }
+  std::vector<uint8_t> out;
+  VectorSink<uint8_t> sink(out);
+  tag.epc_reply(sink, pc_epc);
+
+  BitBuffer framed = pc_epc;
+  framed.append(crc16(pc_epc), 16);
+  CHECK(out == tag.reply<uint8_t>(framed));
+  CHECK(out.size() == tag.reply_length(framed.size()));
+}
@@ -0,0 +1,21 @@
+#include <atomic>
+
+#include "check.hpp"
+#include "reader.hpp"
+#include "thread_pool.hpp"
+
+// Tasks always run with a command arena, and parallel_for leaves none
+// behind on the calling thread.
+TEST(thread_pool_arenas) {
+  ThreadPool pool(2);
+  CHECK(CommandArena::current() == nullptr);
+  std::atomic<int> without{0};
+  pool.parallel_for(64, [&](size_t) { without += CommandArena::current() == nullptr; });
+  CHECK(without == 0);
+  CHECK(pool.submit([] { return CommandArena::current() != nullptr; }).get());
+  CHECK(CommandArena::current() == nullptr);
+
+  CommandArena outer;
+  pool.parallel_for(8, [](size_t) {});
+  CHECK(CommandArena::current() == &outer);
+}